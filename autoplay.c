@@ -0,0 +1,303 @@
+/*
+ * autoplay.c
+ *
+ * Author: Elliot Randall
+ *
+ * The computer player works on its own copies of the board (just the
+ * rows of bits - see game.h), so trying a placement is a few bitwise
+ * operations per row.
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#include "autoplay.h"
+#include "blocks.h"
+#include "input.h"
+
+/*
+ * Weights (in hundredths) for the parts of a board's score. These are
+ * the weights commonly used for this heuristic, which were tuned for a
+ * 10 column board but play well enough on ours.
+ */
+#define HEIGHT_WEIGHT (-51)		// Per square of total column height
+#define LINES_WEIGHT 76			// Per row cleared
+#define HOLES_WEIGHT (-36)		// Per empty square with a filled one above
+#define BUMPINESS_WEIGHT (-18)	// Per square of height difference between
+								// neighbouring columns
+
+// Score for a placement after which the next block can't be added
+#define GAME_OVER_SCORE INT32_MIN
+
+// The lowest score a board can get, which a board score must fit in
+#define LOWEST_SCORE ((int32_t)(HEIGHT_WEIGHT + HOLES_WEIGHT) * \
+		BOARD_ROWS * BOARD_WIDTH + \
+		(int32_t)BUMPINESS_WEIGHT * BOARD_ROWS * (BOARD_WIDTH - 1))
+_Static_assert(LOWEST_SCORE >= INT16_MIN, "Board scores don't fit in 16 bits");
+
+#define MAX_PLACEMENTS (NUM_ROTATIONS * BOARD_WIDTH)
+
+// A rotation and column of a block. These are kept small, as there are
+// two lists of them on the stack while choosing.
+typedef struct {
+	uint8_t rotation;
+	uint8_t column;
+} Placement;
+
+static uint8_t list_placements(const rowtype* board, uint8_t blocknum,
+		Placement* placements);
+static FallingBlock placed_block(uint8_t blocknum, uint8_t rotation,
+		uint8_t column);
+static uint8_t collides(const rowtype* board, const FallingBlock* block,
+		rownum row);
+static uint8_t drop_block(rowtype* board, const FallingBlock* block);
+static int16_t evaluate(const rowtype* board, uint8_t lines);
+static uint8_t count_bits(rowtype bits);
+
+uint8_t autoplay_choose(const GameState* game, AutoplayMove* move) {
+	Placement first[MAX_PLACEMENTS];
+	int16_t first_scores[MAX_PLACEMENTS];
+	Placement second[MAX_PLACEMENTS];
+	rowtype board[BOARD_ROWS];
+	uint8_t blocknum = game->current_block.blocknum;
+	uint8_t next_blocknum = get_next_block(game, 0);
+	uint16_t evaluations = 0;
+
+	// Score every placement of the current block on its own, and sort
+	// them best first (an insertion sort, as there are only a few)
+	uint8_t num_first = list_placements(game->board, blocknum, first);
+	if(num_first == 0) {
+		return 0;
+	}
+	for(uint8_t i = 0; i < num_first; i++) {
+		FallingBlock block = placed_block(blocknum, first[i].rotation,
+				first[i].column);
+		memcpy(board, game->board, sizeof(board));
+		uint8_t lines = drop_block(board, &block);
+		int16_t placement_score = evaluate(board, lines);
+		evaluations++;
+
+		Placement placement = first[i];
+		uint8_t j = i;
+		for(; j > 0 && first_scores[j - 1] < placement_score; j--) {
+			first[j] = first[j - 1];
+			first_scores[j] = first_scores[j - 1];
+		}
+		first[j] = placement;
+		first_scores[j] = placement_score;
+	}
+
+	// Look at the best of these again with the best placement of the
+	// next block added, while the budget lasts. If there isn't enough
+	// budget for any, the best on its own is taken.
+	uint8_t choice = 0;
+	int32_t best_score = GAME_OVER_SCORE;
+	for(uint8_t i = 0; i < num_first; i++) {
+		FallingBlock block = placed_block(blocknum, first[i].rotation,
+				first[i].column);
+		memcpy(board, game->board, sizeof(board));
+		uint8_t lines = drop_block(board, &block);
+		uint8_t num_second = list_placements(board, next_blocknum, second);
+		if(evaluations + num_second > AUTOPLAY_BUDGET) {
+			break;
+		}
+
+		int32_t score = GAME_OVER_SCORE;
+		for(uint8_t j = 0; j < num_second; j++) {
+			rowtype next_board[BOARD_ROWS];
+			FallingBlock next_block = placed_block(next_blocknum,
+					second[j].rotation, second[j].column);
+			memcpy(next_board, board, sizeof(next_board));
+			uint8_t next_lines = drop_block(next_board, &next_block);
+			int16_t next_score = evaluate(next_board, lines + next_lines);
+			if(next_score > score) {
+				score = next_score;
+			}
+		}
+		evaluations += num_second;
+		if(score > best_score) {
+			best_score = score;
+			choice = i;
+		}
+	}
+
+	move->rotation = first[choice].rotation;
+	move->column = first[choice].column;
+	move->steps = 0;
+	move->dropped = 0;
+	return 1;
+}
+
+uint8_t autoplay_next_action(const GameState* game, AutoplayMove* move) {
+	const FallingBlock* block = &game->current_block;
+
+	// Getting there takes at most 3 rotations and a move to each column,
+	// so if it's taking longer the block must be stuck
+	if(move->steps++ > NUM_ROTATIONS + BOARD_WIDTH) {
+		move->dropped = 1;
+	}
+	if(!move->dropped) {
+		if(block->rotation != move->rotation) {
+			return INPUT_ROTATE;
+		} else if(block->column < move->column) {
+			return INPUT_MOVE_LEFT;
+		} else if(block->column > move->column) {
+			return INPUT_MOVE_RIGHT;
+		}
+		move->dropped = 1;
+		return INPUT_HARD_DROP;
+	}
+	return INPUT_SOFT_DROP;
+}
+
+/*
+ * Fill placements with each different rotation and column that the
+ * given block can be dropped from, given that it starts at the top
+ * right of the board and is rotated before being moved left. Return the
+ * number of placements.
+ */
+static uint8_t list_placements(const rowtype* board, uint8_t blocknum,
+		Placement* placements) {
+	FallingBlock rotations[NUM_ROTATIONS];
+	uint8_t count = 0;
+
+	for(uint8_t rotation = 0; rotation < NUM_ROTATIONS; rotation++) {
+		FallingBlock block;
+		if(rotation == 0) {
+			block = new_block(blocknum);
+		} else {
+			block = rotations[rotation - 1];
+			if(!rotate_block(&block)) {
+				break;
+			}
+		}
+		rotations[rotation] = block;
+		if(collides(board, &block, 0)) {
+			break;	// Can't get to this rotation (or any after it)
+		}
+
+		// Rotations which give the same pattern as an earlier one have
+		// the same placements
+		uint8_t repeated = 0;
+		for(uint8_t i = 0; i < rotation; i++) {
+			if(rotations[i].pattern == block.pattern) {
+				repeated = 1;
+			}
+		}
+		if(repeated) {
+			continue;
+		}
+
+		do {
+			if(collides(board, &block, 0)) {
+				break;	// Can't move any further left
+			}
+			placements[count].rotation = rotation;
+			placements[count].column = block.column;
+			count++;
+		} while(move_block_left(&block));
+	}
+	return count;
+}
+
+/*
+ * Return the given block at the top of the board with the given
+ * rotation and column.
+ */
+static FallingBlock placed_block(uint8_t blocknum, uint8_t rotation,
+		uint8_t column) {
+	FallingBlock block = new_block(blocknum);
+	while(block.rotation != rotation) {
+		(void)rotate_block(&block);
+	}
+	block.column = column;
+	return block;
+}
+
+/*
+ * Return 1 if the block would collide with the board if it was at the
+ * given row, 0 otherwise.
+ */
+static uint8_t collides(const rowtype* board, const FallingBlock* block,
+		rownum row) {
+	for(uint8_t i = 0; i < block->height; i++) {
+		if(((rowtype)block->pattern[i] << block->column) & board[row + i]) {
+			return 1;
+		}
+	}
+	return 0;
+}
+
+/*
+ * Drop the block from the top of the board as far as it will go, fix it
+ * to the board and remove any completed rows. Return the number of rows
+ * removed.
+ */
+static uint8_t drop_block(rowtype* board, const FallingBlock* block) {
+	rownum row = 0;
+	while(row + block->height < BOARD_ROWS &&
+			!collides(board, block, row + 1)) {
+		row++;
+	}
+
+	uint8_t lines = 0;
+	for(uint8_t i = 0; i < block->height; i++) {
+		rownum board_row = row + i;
+		board[board_row] |= (rowtype)block->pattern[i] << block->column;
+		if(board[board_row] == FULL_ROW) {
+			memmove(&board[1], &board[0], board_row * sizeof(rowtype));
+			board[0] = 0;
+			lines++;
+		}
+	}
+	return lines;
+}
+
+/*
+ * Score the board (higher is better), given the number of rows which
+ * were cleared to get to it. The score is at least LOWEST_SCORE, so 16
+ * bits are enough (and quicker than 32 on the AVR).
+ */
+static int16_t evaluate(const rowtype* board, uint8_t lines) {
+	rownum heights[BOARD_WIDTH];
+	rowtype filled_above = 0;
+	uint16_t holes = 0;
+
+	// Work down the board. The height of a column is set by the first
+	// row it is filled in, and any empty square after that is a hole.
+	memset(heights, 0, sizeof(heights));
+	for(rownum row = 0; row < BOARD_ROWS; row++) {
+		rowtype new_columns = board[row] & ~filled_above;
+		holes += count_bits(filled_above & ~board[row]);
+		filled_above |= board[row];
+		for(uint8_t col = 0; new_columns; col++) {
+			if(new_columns & 1) {
+				heights[col] = BOARD_ROWS - row;
+			}
+			new_columns >>= 1;
+		}
+	}
+
+	uint16_t total_height = heights[0];
+	uint16_t bumpiness = 0;
+	for(uint8_t col = 1; col < BOARD_WIDTH; col++) {
+		total_height += heights[col];
+		bumpiness += (heights[col] > heights[col - 1]) ?
+				heights[col] - heights[col - 1] :
+				heights[col - 1] - heights[col];
+	}
+
+	return (int16_t)(HEIGHT_WEIGHT * (int16_t)total_height +
+			LINES_WEIGHT * (int16_t)lines +
+			HOLES_WEIGHT * (int16_t)holes +
+			BUMPINESS_WEIGHT * (int16_t)bumpiness);
+}
+
+static uint8_t count_bits(rowtype bits) {
+	uint8_t count = 0;
+	while(bits) {
+		bits &= bits - 1;	// Clear the lowest set bit
+		count++;
+	}
+	return count;
+}
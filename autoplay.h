@@ -0,0 +1,52 @@
+/*
+ * autoplay.h
+ *
+ * Author: Elliot Randall
+ *
+ * A computer player, used for the attract mode (see project.c) and by
+ * host simulations. For each new block, autoplay_choose() tries every
+ * rotation and column the block can be dropped from, along with every
+ * place the next block could then go, and scores the boards which would
+ * result by their height, holes, bumpiness and rows cleared.
+ * autoplay_next_action() then gives the game actions (see input.h)
+ * which take the block there, so the computer plays through the same
+ * code as a player.
+ *
+ * Choosing is limited to AUTOPLAY_BUDGET board evaluations per block, so
+ * it takes a bounded time whatever is on the board. Every placement of
+ * the current block is scored first. The best of these are then looked
+ * at again with the next block placed as well, best first, for as long
+ * as the budget lasts. The same game always gets the same choices.
+ */
+
+#ifndef AUTOPLAY_H_
+#define AUTOPLAY_H_
+
+#include <stdint.h>
+#include "game.h"
+
+#define AUTOPLAY_BUDGET 200
+
+/* Where the current block is to go, and how far it has got there. */
+typedef struct {
+	uint8_t rotation;
+	uint8_t column;
+	uint8_t steps;		// Actions given so far
+	uint8_t dropped;	// Set once the block has been hard dropped
+} AutoplayMove;
+
+/* Choose where to place the current block of the given game. Returns 0
+ * if the block can't go anywhere (the game is about to end), 1
+ * otherwise.
+ */
+uint8_t autoplay_choose(const GameState* game, AutoplayMove* move);
+
+/* Return the next game action to take the current block to the chosen
+ * placement: rotations, then moves, then a hard drop followed by soft
+ * drops until the block is fixed. If the block can't be moved where it
+ * was meant to go (e.g. gravity has dropped it under an overhang), it
+ * is dropped where it is.
+ */
+uint8_t autoplay_next_action(const GameState* game, AutoplayMove* move);
+
+#endif /* AUTOPLAY_H_ */
@@ -4,24 +4,88 @@
  * Written by Peter Sutton.
  */
 
+#include <avr/pgmspace.h>
+
 #include "blocks.h"
 #include "game.h"
 #include "pixel_colour.h"
-#include <stdlib.h>
-/* Stdlib needed for random() - random number generator */
 
 /*
- * Define the block library. 
- * Five blocks are defined initially.
+ * Block previews (see block_preview() in blocks.h) are built at compile
+ * time from a block's rows in its default rotation, so they are kept as
+ * ready to send strings in program memory. Each position of the block
+ * is two characters wide, so that it looks square, and is drawn in the 
+ * xterm 256 colour closest to the block's colour. A row of the preview
+ * is given by the row's bit pattern, e.g. PREVIEW_ROW(colour, 0b010),
+ * and ends by moving the cursor to the start of the next row.
  */
+#define PREVIEW_BG(colour) "\x1b[48;5;" colour "m"
+#define PREVIEW_OFF "\x1b[0m"
+#define PREVIEW_NEXT_ROW "\x1b[B\x1b[6D"
+#define PREVIEW_END "\x1b[3A\x1b[8C"
+
+#define PREVIEW_ROW(colour, bits) PREVIEW_ROW_ ## bits(colour)
+#define PREVIEW_ROW_0b0(colour) "      " PREVIEW_NEXT_ROW
+#define PREVIEW_ROW_0b001(colour) \
+		"    " PREVIEW_BG(colour) "  " PREVIEW_OFF PREVIEW_NEXT_ROW
+#define PREVIEW_ROW_0b010(colour) \
+		"  " PREVIEW_BG(colour) "  " PREVIEW_OFF "  " PREVIEW_NEXT_ROW
+#define PREVIEW_ROW_0b011(colour) \
+		"  " PREVIEW_BG(colour) "    " PREVIEW_OFF PREVIEW_NEXT_ROW
+#define PREVIEW_ROW_0b100(colour) \
+		PREVIEW_BG(colour) "  " PREVIEW_OFF "    " PREVIEW_NEXT_ROW
+#define PREVIEW_ROW_0b101(colour) \
+		PREVIEW_BG(colour) "  " PREVIEW_OFF "  " PREVIEW_BG(colour) "  " \
+		PREVIEW_OFF PREVIEW_NEXT_ROW
+#define PREVIEW_ROW_0b110(colour) \
+		PREVIEW_BG(colour) "    " PREVIEW_OFF "  " PREVIEW_NEXT_ROW
+#define PREVIEW_ROW_0b111(colour) \
+		PREVIEW_BG(colour) "      " PREVIEW_OFF PREVIEW_NEXT_ROW
+#define PREVIEW_ROW_0b1 PREVIEW_ROW_0b001
+#define PREVIEW_ROW_0b01 PREVIEW_ROW_0b001
+#define PREVIEW_ROW_0b10 PREVIEW_ROW_0b010
+#define PREVIEW_ROW_0b11 PREVIEW_ROW_0b011
 
-#define NUM_BLOCKS_IN_LIBRARY 5
+// A preview of the given rows. Blocks with fewer than 3 rows are padded
+// with empty rows.
+#define PREVIEW(colour, rows) PREVIEW_ROWS(colour, rows, 0b0, 0b0)
+#define PREVIEW_ROWS(colour, row0, row1, row2, ...) \
+		PREVIEW_ROW(colour, row0) PREVIEW_ROW(colour, row1) \
+		PREVIEW_ROW(colour, row2) PREVIEW_END
+
+// xterm 256 colour numbers for the block colours. A block's colour is
+// given by name (e.g. BLOCK_0_COLOUR below is RED), and BLOCK_COLOUR()
+// and PREVIEW_COLOUR() give its LED matrix colour (COLOUR_RED in 
+// pixel_colour.h) and its preview colour (PREVIEW_RED) from the name, 
+// so the two can't get out of step. A colour without a preview colour
+// here doesn't compile.
+#define PREVIEW_RED "196"
+#define PREVIEW_ORANGE "208"
+#define PREVIEW_GREEN "46"
+#define PREVIEW_YELLOW "226"
+#define PREVIEW_LIGHT_ORANGE "130"
+
+#define BLOCK_COLOUR(name) BLOCK_COLOUR_NAMED(name)
+#define BLOCK_COLOUR_NAMED(name) COLOUR_ ## name
+#define PREVIEW_COLOUR(name) PREVIEW_COLOUR_NAMED(name)
+#define PREVIEW_COLOUR_NAMED(name) PREVIEW_ ## name
+
+/*
+ * Define the block library. 
+ * Five blocks are defined initially (NUM_BLOCKS_IN_LIBRARY in blocks.h).
+ * The rows of each block's default rotation are given by a macro so 
+ * that its preview can be built from them.
+ */
 
 // Block 0 (1 x 1) only has one pattern (rotation doesn't change this)
 // -------*
 #define BLOCK_0_HEIGHT 1
 #define BLOCK_0_WIDTH 1
-static rowtype block_0[] = { 0b1 };
+#define BLOCK_0_ROWS 0b1
+#define BLOCK_0_COLOUR RED
+static rowtype block_0[] = { BLOCK_0_ROWS };
+static const char block_0_preview[] PROGMEM = 
+		PREVIEW(PREVIEW_COLOUR(BLOCK_0_COLOUR), BLOCK_0_ROWS);
 
 // Block 1 (3 x 1) has two patterns
 // -------* -----***
@@ -29,15 +93,23 @@ static rowtype block_0[] = { 0b1 };
 // -------*
 #define BLOCK_1_HEIGHT 3
 #define BLOCK_1_WIDTH 1
-static rowtype block_1_vert[] = { 0b1, 0b1, 0b1 };
+#define BLOCK_1_ROWS 0b1, 0b1, 0b1
+#define BLOCK_1_COLOUR ORANGE
+static rowtype block_1_vert[] = { BLOCK_1_ROWS };
 static rowtype block_1_horiz[] = { 0b111 };
+static const char block_1_preview[] PROGMEM = 
+		PREVIEW(PREVIEW_COLOUR(BLOCK_1_COLOUR), BLOCK_1_ROWS);
 	
 // Block 2 (2 x 2) has only one pattern
 // ------**
 // ------**
 #define BLOCK_2_HEIGHT 2
 #define BLOCK_2_WIDTH 2
-static rowtype block_2[] = { 0b11, 0b11 };
+#define BLOCK_2_ROWS 0b11, 0b11
+#define BLOCK_2_COLOUR GREEN
+static rowtype block_2[] = { BLOCK_2_ROWS };
+static const char block_2_preview[] PROGMEM = 
+		PREVIEW(PREVIEW_COLOUR(BLOCK_2_COLOUR), BLOCK_2_ROWS);
 	
 // Block 3 (2 x 3) has four patterns
 // ------*- ------*- -----*** -------*
@@ -45,10 +117,14 @@ static rowtype block_2[] = { 0b11, 0b11 };
 //          ------*-          -------*         
 #define BLOCK_3_HEIGHT 2
 #define BLOCK_3_WIDTH 3
-static rowtype block_3_rot_0[] = { 0b010, 0b111 };
+#define BLOCK_3_ROWS 0b010, 0b111
+#define BLOCK_3_COLOUR YELLOW
+static rowtype block_3_rot_0[] = { BLOCK_3_ROWS };
 static rowtype block_3_rot_1[] = { 0b10, 0b11, 0b10 };
 static rowtype block_3_rot_2[] = { 0b111, 0b010 };
 static rowtype block_3_rot_3[] = { 0b01, 0b11, 0b01 };
+static const char block_3_preview[] PROGMEM = 
+		PREVIEW(PREVIEW_COLOUR(BLOCK_3_COLOUR), BLOCK_3_ROWS);
 
 // Block 4 (2 x 3) has four patterns
 // -------* ------*- -----*** ------**
@@ -56,40 +132,70 @@ static rowtype block_3_rot_3[] = { 0b01, 0b11, 0b01 };
 //          ------**          -------*
 #define BLOCK_4_HEIGHT 2
 #define BLOCK_4_WIDTH 3
-static rowtype block_4_rot_0[] = { 0b001, 0b111 };
+#define BLOCK_4_ROWS 0b001, 0b111
+#define BLOCK_4_COLOUR LIGHT_ORANGE
+static rowtype block_4_rot_0[] = { BLOCK_4_ROWS };
 static rowtype block_4_rot_1[] = { 0b10, 0b10, 0b11 };
 static rowtype block_4_rot_2[] = { 0b111, 0b100 };
 static rowtype block_4_rot_3[] = { 0b11, 0b01, 0b01 };
+static const char block_4_preview[] PROGMEM = 
+		PREVIEW(PREVIEW_COLOUR(BLOCK_4_COLOUR), BLOCK_4_ROWS);
 	
 static const BlockInfo block_library[NUM_BLOCKS_IN_LIBRARY] = {
 	{ // Block 0
-		COLOUR_RED, BLOCK_0_HEIGHT, BLOCK_0_WIDTH, 
-		{ block_0, block_0, block_0, block_0 }
+		BLOCK_COLOUR(BLOCK_0_COLOUR), BLOCK_0_HEIGHT, BLOCK_0_WIDTH, 
+		{ block_0, block_0, block_0, block_0 }, block_0_preview
 	},
 	{ // Block 1
-		COLOUR_ORANGE, BLOCK_1_HEIGHT, BLOCK_1_WIDTH,
-		{ block_1_vert, block_1_horiz, block_1_vert, block_1_horiz }
+		BLOCK_COLOUR(BLOCK_1_COLOUR), BLOCK_1_HEIGHT, BLOCK_1_WIDTH,
+		{ block_1_vert, block_1_horiz, block_1_vert, block_1_horiz }, 
+		block_1_preview
 	},
 	{ // Block 2
-		COLOUR_GREEN, BLOCK_2_HEIGHT, BLOCK_2_WIDTH,
-		{ block_2, block_2, block_2, block_2 }
+		BLOCK_COLOUR(BLOCK_2_COLOUR), BLOCK_2_HEIGHT, BLOCK_2_WIDTH,
+		{ block_2, block_2, block_2, block_2 }, block_2_preview
 	},
 	{ // Block 3
-		COLOUR_YELLOW, BLOCK_3_HEIGHT, BLOCK_3_WIDTH,
-		{ block_3_rot_0, block_3_rot_1, block_3_rot_2, block_3_rot_3 }		
+		BLOCK_COLOUR(BLOCK_3_COLOUR), BLOCK_3_HEIGHT, BLOCK_3_WIDTH,
+		{ block_3_rot_0, block_3_rot_1, block_3_rot_2, block_3_rot_3 },
+		block_3_preview
 	},
 	{ // Block 4
-		COLOUR_LIGHT_ORANGE, BLOCK_4_HEIGHT, BLOCK_4_WIDTH,
-		{ block_4_rot_0, block_4_rot_1, block_4_rot_2, block_4_rot_3 }	
+		BLOCK_COLOUR(BLOCK_4_COLOUR), BLOCK_4_HEIGHT, BLOCK_4_WIDTH,
+		{ block_4_rot_0, block_4_rot_1, block_4_rot_2, block_4_rot_3 },
+		block_4_preview
 	}
 };
 	
 	
-FallingBlock generate_random_block(void) {
+/*
+ * Our block random number generator is a 32 bit xorshift. We use it 
+ * rather than random() so that a given seed produces the same sequence
+ * of blocks here and in host builds of the game - this is what allows 
+ * recorded games to be replayed - and so that each game has its own
+ * generator. The state must never be zero.
+ */
+void seed_block_generator(uint32_t* random_state, uint32_t seed) {
+	*random_state = seed ? seed : 1;
+}
+
+static uint32_t next_random(uint32_t* random_state) {
+	uint32_t x = *random_state;
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	*random_state = x;
+	return x;
+}
+
+uint8_t random_block_number(uint32_t* random_state) {
+	return next_random(random_state) % NUM_BLOCKS_IN_LIBRARY;
+}
+
+FallingBlock new_block(uint8_t blocknum) {
 	FallingBlock block;	// This will be our return value
 
-	// Pick a random block
-	block.blocknum = random() % NUM_BLOCKS_IN_LIBRARY;
+	block.blocknum = blocknum;
 	
 	// Initial rotation (no rotation by default)
 	block.rotation = 0;	
@@ -110,6 +216,14 @@ FallingBlock generate_random_block(void) {
 	return block;
 }
 
+PixelColour block_colour(uint8_t blocknum) {
+	return block_library[blocknum].colour;
+}
+
+const char* block_preview(uint8_t blocknum) {
+	return block_library[blocknum].preview;
+}
+
 /*
  * Attempt to rotate the given block clockwise by 90 degrees.
  * Returns 1 if successful (and modifies the given block) otherwise
@@ -9,12 +9,7 @@
 
 #include <stdint.h>
 #include "pixel_colour.h"
-
-/*
- * Type used to store row data. Must be able to hold BOARD_WIDTH number
- * of bits (defined in board.h)
-*/
-typedef uint8_t rowtype;
+#include "board.h"	// For rowtype (row data) and rownum
 
 /*
  * Blocks are represented as bit patterns in an array of rows. We 
@@ -40,6 +35,8 @@ typedef const rowtype* BlockPattern;
  * of rows and columns the block has (in the default (0) rotation).
  * These dimensions will also apply to rotation 2. Rotations 1 and 3
  * dimensions are given by swapping these row and column numbers.
+ * The preview is the block (in the default rotation) drawn on the 
+ * terminal - see block_preview() below.
  */
 #define NUM_ROTATIONS 4
 typedef struct {
@@ -47,8 +44,15 @@ typedef struct {
 	uint8_t height;	// Number of rows (in the default (0) rotation)
 	uint8_t width;  // Number of columns (in the default (0) rotation)
 	BlockPattern patterns[NUM_ROTATIONS];
+	const char* preview;	// In program memory
 } BlockInfo;
 
+/*
+ * Number of blocks in the block library (blocks.c). Block numbers run
+ * from 0 to NUM_BLOCKS_IN_LIBRARY-1.
+ */
+#define NUM_BLOCKS_IN_LIBRARY 5
+
 /*
  * Data for a falling block includes
  * - which block it is (0+ for block index)
@@ -64,18 +68,50 @@ typedef struct {
 	int8_t blocknum;
 	BlockPattern pattern;
 	PixelColour colour;
-	uint8_t row;
+	rownum row;
 	uint8_t column;
 	uint8_t rotation;
 	uint8_t width;
 	uint8_t height;
 } FallingBlock;
 
+/*
+ * Seed the random number generator (whose state is kept in 
+ * *random_state) used to choose blocks. The same seed always gives the
+ * same sequence of blocks.
+ */
+void seed_block_generator(uint32_t* random_state, uint32_t seed);
+
 /* 
- * Randomly choose a block from the block library and position
- * it at the top of the board.
+ * Randomly choose a block from the block library and return its number.
+ */
+uint8_t random_block_number(uint32_t* random_state);
+
+/*
+ * Return the given block (0 to NUM_BLOCKS_IN_LIBRARY-1) positioned at
+ * the top of the board, as if it had just been generated.
+ */
+FallingBlock new_block(uint8_t blocknum);
+
+/*
+ * Return the colour of the given block.
+ */
+PixelColour block_colour(uint8_t blocknum);
+
+/*
+ * Return the escape sequences which draw the given block on the terminal
+ * as a string in program memory (e.g. for serial_write_P()). The block 
+ * is drawn in its default rotation in its own colour, right aligned in
+ * a box BLOCK_PREVIEW_HEIGHT rows high and BLOCK_PREVIEW_WIDTH characters
+ * wide with the top left at the cursor. Positions in the box which 
+ * aren't part of the block are blanked. The cursor is left 
+ * BLOCK_PREVIEW_SPACING characters to the right of where it started, 
+ * ready for the next preview.
  */
-FallingBlock generate_random_block(void);
+#define BLOCK_PREVIEW_HEIGHT 3
+#define BLOCK_PREVIEW_WIDTH 6
+#define BLOCK_PREVIEW_SPACING 8
+const char* block_preview(uint8_t blocknum);
 
 /*
  * Attempt to rotate the given block clockwise by 90 degrees.
@@ -0,0 +1,57 @@
+/*
+ * board.h
+ *
+ * Author: Elliot Randall
+ *
+ * Size of the game board and the type used to store its rows. The 
+ * defaults match the LED matrix (16 rows of 8 columns), but either can
+ * be changed at compile time (e.g. -DBOARD_ROWS=20 -DBOARD_WIDTH=10 for
+ * a host build) and the narrowest types which fit are chosen here, so 
+ * the board code is built for the size it will be used with. 
+ */
+
+#ifndef BOARD_H_
+#define BOARD_H_
+
+#include <stdint.h>
+
+/*
+ * The game board is BOARD_ROWS rows in size. Row 0 is considered to be 
+ * at the top, row BOARD_ROWS-1 is at the bottom. Each row is BOARD_WIDTH
+ * columns wide.
+ */
+#ifndef BOARD_ROWS
+#define BOARD_ROWS 16
+#endif
+#ifndef BOARD_WIDTH
+#define BOARD_WIDTH 8
+#endif
+
+/*
+ * Type used to store row data - one bit for each column. 
+ */
+#if BOARD_WIDTH <= 8
+typedef uint8_t rowtype;
+#elif BOARD_WIDTH <= 16
+typedef uint16_t rowtype;
+#elif BOARD_WIDTH <= 32
+typedef uint32_t rowtype;
+#else
+#error "BOARD_WIDTH can be at most 32"
+#endif
+
+/* A row with every column occupied */
+#define FULL_ROW ((rowtype)((rowtype)~(rowtype)0 >> \
+		(8 * sizeof(rowtype) - BOARD_WIDTH)))
+
+/*
+ * Type used for row numbers. This must be able to hold BOARD_ROWS (the
+ * row after the bottom row).
+ */
+#if BOARD_ROWS < 256
+typedef uint8_t rownum;
+#else
+typedef uint16_t rownum;
+#endif
+
+#endif /* BOARD_H_ */
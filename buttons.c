@@ -7,21 +7,40 @@
 #include <avr/io.h>
 #include <avr/interrupt.h>
 #include "buttons.h"
+#include "timer0.h"
+#include "input.h"
 
-// Global variable to keep track of the last button state so that we 
-// can detect changes when an interrupt fires. The lower 4 bits (0 to 3)
-// will correspond to the last state of port B pins 0 to 3.
+// Debounced state of the buttons so that we can detect changes when an
+// interrupt fires. The lower 4 bits (0 to 3) correspond to the state of
+// port B pins 0 to 3 as last accepted by the debouncing below.
 static volatile uint8_t last_button_state;
 
-// Our button queue. button_queue[0] is always the head of the queue. If we
-// take something off the queue we just move everything else along. We don't
-// use a circular buffer since it is usually expected that the queue is very
-// short. In most uses it will never have more than 1 element at a time.
-// This button queue can be changed by the interrupt handler below so we should
-// turn off interrupts if we're changing the queue outside the handler.
+// Clock tick value at which each button last changed state (after
+// debouncing). Used both to debounce and to work out hold times.
+static volatile uint32_t last_change_time[NUM_BUTTONS];
+
+// Set while any button's pin has changed within BUTTON_DEBOUNCE_TIME of
+// its last accepted change. See button_check_pending().
+static volatile uint8_t button_resample_pending;
+
+// Our button event queue. This is a circular buffer - the interrupt
+// handler adds events at queue_tail and they are removed from queue_head.
+// Each index is only written by one side (and is a single byte) so we
+// don't need to turn off interrupts to take an event off the queue.
+// The buffer is full when advancing queue_tail would make it equal
+// queue_head, so it holds up to BUTTON_QUEUE_SIZE-1 events. Events which
+// arrive when the queue is full are discarded and counted.
 #define BUTTON_QUEUE_SIZE 8
-static volatile uint8_t button_queue[BUTTON_QUEUE_SIZE];
-static volatile int8_t queue_length;
+static volatile ButtonEvent button_queue[BUTTON_QUEUE_SIZE];
+static volatile uint8_t queue_head;
+static volatile uint8_t queue_tail;
+static volatile uint16_t dropped_events;
+
+// Game action for a push of each button - used when input is being
+// routed to the input event queue (see input.h)
+static const uint8_t button_action[NUM_BUTTONS] = {
+	INPUT_MOVE_RIGHT, INPUT_HARD_DROP, INPUT_ROTATE, INPUT_MOVE_LEFT
+};
 
 // Setup interrupt if any of pins B0 to B3 change. We do this
 // using a pin change interrupt. These pins correspond to pin
@@ -39,38 +58,63 @@ void init_button_interrupts(void) {
 	// the relevant bits in the mask register (see datasheet page 70)
 	PCMSK1 |= (1<<PCINT8)|(1<<PCINT9)|(1<<PCINT10)|(1<<PCINT11);	
 	
-	// Empty the button push queue
-	queue_length = 0;
+	// Start from the current state of the buttons and empty the 
+	// event queue
+	last_button_state = PINB & 0x0F;
+	button_resample_pending = 0;
+	queue_head = queue_tail = 0;
+	dropped_events = 0;
 }
 
 void empty_button_queue(void) {
-	queue_length = 0;
+	queue_head = queue_tail;
+}
+
+uint8_t button_get_event(ButtonEvent* event) {
+	if(queue_head == queue_tail) {
+		return 0;
+	}
+	*event = button_queue[queue_head];
+	queue_head = (queue_head + 1) % BUTTON_QUEUE_SIZE;
+	return 1;
 }
 
 int8_t button_pushed(void) {
-	int8_t return_value = -1;	// Assume no button pushed
-	if(queue_length > 0) {
-		// Remove the first element off the queue and move all the other
-		// entries closer to the front of the queue. We turn off interrupts (if on)
-		// before we make any changes to the queue. If interrupts were on
-		// we turn them back on when done.
-		return_value = button_queue[0];
-		
-		// Save whether interrupts were enabled and turn them off
-		int8_t interrupts_were_enabled = bit_is_set(SREG, SREG_I);
-		cli();
-		
-		for(uint8_t i = 1; i < queue_length; i++) {
-			button_queue[i-1] = button_queue[i];
-		}
-		queue_length--;
-		
-		if(interrupts_were_enabled) {
-			// Turn them back on again
-			sei();
+	ButtonEvent event;
+	// Discard any releases until we find a push (or run out of events)
+	while(button_get_event(&event)) {
+		if(event.action == BUTTON_PRESS) {
+			return event.button;
 		}
 	}
-	return return_value;
+	return -1;
+}
+
+uint32_t button_hold_time(uint8_t button) {
+	uint32_t pressed_at;
+	if(!(last_button_state & (1 << button))) {
+		return 0;	// Not being held
+	}
+	// The press time is 32 bits and can be changed by the interrupt
+	// handler so we copy it with interrupts off
+	uint8_t interrupts_were_on = bit_is_set(SREG, SREG_I);
+	cli();
+	pressed_at = last_change_time[button];
+	if(interrupts_were_on) {
+		sei();
+	}
+	return get_clock_ticks() - pressed_at;
+}
+
+uint16_t button_dropped_event_count(void) {
+	uint16_t count;
+	uint8_t interrupts_were_on = bit_is_set(SREG, SREG_I);
+	cli();
+	count = dropped_events;
+	if(interrupts_were_on) {
+		sei();
+	}
+	return count;
 }
 
 /*int8_t button_pushed_with_pause(uint8_t paused) {
@@ -104,36 +148,74 @@ int8_t button_pushed(void) {
 	
 }*/
 
-// Interrupt handler for a change on buttons
-ISR(PCINT1_vect) {
-	// Get the current state of the buttons. We'll compare this with
-	// the last state to see what has changed.
+/*
+ * Compare the buttons with their last (debounced) state and handle any
+ * which have changed. A change is ignored if it happens within 
+ * BUTTON_DEBOUNCE_TIME of the last accepted change for that button 
+ * (i.e. it's contact bounce), but the button is then sampled again 
+ * until the debounce time is up. If input is being routed to the input
+ * event queue, pushes are posted there as game actions. Otherwise 
+ * accepted changes (both pushes and releases) are added to our queue if
+ * there is space, otherwise they are counted as dropped. Called from 
+ * the pin change interrupt handler and, while a button is waiting to be
+ * sampled again, from button_check_pending() with interrupts off.
+ */
+static void button_resample(void) {
 	uint8_t button_state = PINB & 0x0F;
+	uint8_t changed = button_state ^ last_button_state;
+	uint8_t pending = 0;
+	uint32_t now = get_clock_ticks();
 
-	// If we have space in the queue, then iterate over all the buttons
-	// and see which ones have changed.	If we have no space in the queue
-	// we don't bother - we just ignore the button event.  (Ideally
-	// this should never happen.)
-	if(queue_length < BUTTON_QUEUE_SIZE) {
-		// Iterate over all the buttons and see which ones have changed.
-		// Any button pushes are added to the queue of button pushes (if
-		// there is space). We ignore button releases so we're just looking
-		// for a transition from 0 in the last_button_state bit to a 1 in the
-		// button_state.
-		for(uint8_t pin=0; pin<=3; pin++) {
-			if((button_state & (1<<pin)) &&	!(last_button_state & (1<<pin))) {
-				// Add the button push to the queue (and update the
-				// length of the queue). If the queue is now full, we stop
-				// processing (i.e. ignore other button events if there
-				// are any)
-				button_queue[queue_length++] = pin;
-				if(queue_length >= BUTTON_QUEUE_SIZE) {
-					break;
-				}
+	for(uint8_t pin=0; pin<NUM_BUTTONS; pin++) {
+		if(!(changed & (1<<pin))) {
+			continue;
+		}
+		if(now - last_change_time[pin] < BUTTON_DEBOUNCE_TIME) {
+			pending |= (1<<pin);
+			continue;
+		}
+		last_change_time[pin] = now;
+		last_button_state ^= (1<<pin);
+		
+		if(input_enabled()) {
+			if(button_state & (1<<pin)) {
+				input_post_event(INPUT_SOURCE_BUTTON, button_action[pin]);
 			}
+			continue;
 		}
-	}
 		
-	// Remember this button state so we can detect changes next time
-	last_button_state = button_state;
+		uint8_t next_tail = (queue_tail + 1) % BUTTON_QUEUE_SIZE;
+		if(next_tail == queue_head) {
+			if(dropped_events != UINT16_MAX) {
+				dropped_events++;
+			}
+		} else {
+			button_queue[queue_tail].button = pin;
+			button_queue[queue_tail].action = 
+					(button_state & (1<<pin)) ? BUTTON_PRESS : BUTTON_RELEASE;
+			button_queue[queue_tail].time = now;
+			queue_tail = next_tail;
+		}
+	}
+	
+	// Sample again from the main loop while any change is waiting out
+	// its debounce time
+	button_resample_pending = pending;
+}
+
+void button_check_pending(void) {
+	if(!button_resample_pending) {
+		return;
+	}
+	uint8_t interrupts_were_on = bit_is_set(SREG, SREG_I);
+	cli();
+	button_resample();
+	if(interrupts_were_on) {
+		sei();
+	}
+}
+
+// Interrupt handler for a change on buttons
+ISR(PCINT1_vect) {
+	button_resample();
 }
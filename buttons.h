@@ -4,7 +4,8 @@
  * Author: Peter Sutton
  *
  * We assume four push buttons (B0 to B3) are connected to pins B0 to B3. We configure
- * pin change interrupts on these pins.
+ * pin change interrupts on these pins. Button presses and releases are
+ * debounced and queued with a timestamp.
  */ 
 
 
@@ -19,16 +20,61 @@
  */
 void init_button_interrupts(void);
 
-/* Empty the button press queue
+#define NUM_BUTTONS 4
+
+/* Changes on a button within this many milliseconds of the last 
+ * accepted change are treated as contact bounce and ignored. The button
+ * is sampled again once this time is up, so a change which has stuck 
+ * (e.g. the release of a quick tap) is still picked up, just late.
+ */
+#define BUTTON_DEBOUNCE_TIME 20
+
+#define BUTTON_PRESS 1
+#define BUTTON_RELEASE 0
+
+/* A button event - which button (0 to 3), whether it was pressed or
+ * released, and the clock tick value (see timer0.h) when it happened.
+ */
+typedef struct {
+	uint8_t button;
+	uint8_t action;
+	uint32_t time;
+} ButtonEvent;
+
+/* Empty the button event queue
  */
 void empty_button_queue(void);
 
+/* Get the next button event (press or release). Returns 1 and fills
+ * in the event if there is one, 0 if the queue is empty.
+ */
+uint8_t button_get_event(ButtonEvent* event);
+
+/* Return how long (in milliseconds) the given button (0 to 3) has been 
+ * held down for, or 0 if it is not currently held.
+ */
+uint32_t button_hold_time(uint8_t button);
+
+/* Sample the buttons again if a change was ignored because it came 
+ * within BUTTON_DEBOUNCE_TIME of the button's last accepted change. Any
+ * change which is still there once the debounce time is up is then 
+ * accepted. Should be called repeatedly from the main loop - it returns
+ * straight away if nothing is waiting.
+ */
+void button_check_pending(void);
+
+/* Return the number of button events discarded because the queue was
+ * full (saturates at 65535).
+ */
+uint16_t button_dropped_event_count(void);
+
 //int8_t button_pushed_with_pause(uint8_t paused);
 
 /* Return the last button pushed (0 to 3) or -1 if there are no
- * button pushes to return. (A small queue of button pushes is
+ * button pushes to return. Any button releases ahead of the push in
+ * the queue are discarded. (A small queue of button events is
  * kept. This function should be called frequently enough to
- * ensure the queue does not overflow. Excess button pushes are
+ * ensure the queue does not overflow. Excess button events are
  * discarded.)
  */
 
@@ -0,0 +1,126 @@
+/*
+ * eeprom_queue.c
+ *
+ * Author: Elliot Randall
+ *
+ * See eeprom_queue.h for details.
+ */
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+
+#include "eeprom_queue.h"
+
+/* A run of bytes to be written to consecutive addresses. The bytes 
+ * themselves are kept in order in queued_data.
+ */
+typedef struct {
+	uint16_t address;	// Where the next byte of the run goes
+	uint8_t length;		// Bytes of the run still to be written
+} QueuedRun;
+
+/* Bytes and runs are added at the head and written from the tail */
+static uint8_t queued_data[EEPROM_QUEUE_SIZE];
+static volatile uint8_t data_head;
+static volatile uint8_t data_tail;
+static volatile uint8_t data_length;
+static QueuedRun runs[EEPROM_QUEUE_RUNS];
+static volatile uint8_t run_head;
+static volatile uint8_t run_tail;
+static volatile uint8_t num_runs;
+
+void eeprom_queue_write(uint16_t address, const void* data, uint8_t length) {
+	const uint8_t* bytes = data;
+	
+	for(uint8_t i = 0; i < length; i++) {
+		// Wait for room in the queue. A byte which carries on the last
+		// run doesn't need a free run, so a write only ever waits for 
+		// one before its first byte.
+		uint8_t interrupts_were_on;
+		uint8_t new_run;
+		while(1) {
+			interrupts_were_on = bit_is_set(SREG, SREG_I);
+			cli();
+			QueuedRun* last = &runs[(run_head + EEPROM_QUEUE_RUNS - 1) %
+					EEPROM_QUEUE_RUNS];
+			new_run = !num_runs || last->length == UINT8_MAX ||
+					(uint16_t)(last->address + last->length) != 
+					(uint16_t)(address + i);
+			if(data_length < EEPROM_QUEUE_SIZE && 
+					(!new_run || num_runs < EEPROM_QUEUE_RUNS)) {
+				break;
+			}
+			if(interrupts_were_on) {
+				sei();
+			}
+		}
+		if(!new_run) {
+			runs[(run_head + EEPROM_QUEUE_RUNS - 1) % 
+					EEPROM_QUEUE_RUNS].length++;
+		} else {
+			runs[run_head].address = address + i;
+			runs[run_head].length = 1;
+			run_head = (run_head + 1) % EEPROM_QUEUE_RUNS;
+			num_runs++;
+		}
+		queued_data[data_head] = bytes[i];
+		data_head = (data_head + 1) % EEPROM_QUEUE_SIZE;
+		data_length++;
+		
+		// Enable the EEPROM ready interrupt. This fires as soon as no 
+		// write is in progress.
+		EECR |= (1<<EERIE);
+		if(interrupts_were_on) {
+			sei();
+		}
+	}
+}
+
+uint8_t eeprom_queue_pending(void) {
+	return data_length;
+}
+
+uint8_t eeprom_queue_space(void) {
+	if(num_runs >= EEPROM_QUEUE_RUNS) {
+		return 0;
+	}
+	return EEPROM_QUEUE_SIZE - data_length;
+}
+
+void eeprom_queue_flush(void) {
+	while(data_length) {
+		;
+	}
+}
+
+/* Interrupt handler which fires while the EEPROM is ready for another 
+ * write. We start writing the next byte which differs from what is in
+ * EEPROM, or turn the interrupt off if there are none left.
+ */
+ISR(EE_READY_vect) {
+	while(num_runs) {
+		QueuedRun* run = &runs[run_tail];
+		uint16_t address = run->address++;
+		uint8_t value = queued_data[data_tail];
+		data_tail = (data_tail + 1) % EEPROM_QUEUE_SIZE;
+		data_length--;
+		if(--run->length == 0) {
+			run_tail = (run_tail + 1) % EEPROM_QUEUE_RUNS;
+			num_runs--;
+		}
+		
+		EEAR = address;
+		EECR |= (1<<EERE);
+		if(EEDR != value) {
+			/* Erase and write (EEPM bits 0). EEPE must be set within 
+			 * four clock cycles of EEMPE, which is why interrupts must be
+			 * off here.
+			 */
+			EEDR = value;
+			EECR = (1<<EERIE) | (1<<EEMPE);
+			EECR |= (1<<EEPE);
+			return;
+		}
+	}
+	EECR &= ~(1<<EERIE);
+}
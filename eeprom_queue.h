@@ -0,0 +1,54 @@
+/*
+ * eeprom_queue.h
+ *
+ * Author: Elliot Randall
+ *
+ * Writes to EEPROM in the background. Each byte takes about 3.3ms to 
+ * write, so rather than waiting, callers add the bytes to a queue and 
+ * carry on. The EEPROM ready interrupt handler writes the queued bytes
+ * one at a time, skipping any that are already the same in EEPROM (as
+ * eeprom_update_byte() does). Bytes are written in the order they were
+ * queued. The queue keeps runs of bytes for consecutive addresses, so 
+ * each byte only takes one byte of RAM.
+ *
+ * EEPROM must not be read at all (with the avr/eeprom.h functions) 
+ * while bytes are queued - call eeprom_queue_flush() first. It isn't 
+ * just the locations being written which are unsafe: the interrupt 
+ * handler changes the address register between bytes, and a read is 
+ * ignored while a write is in progress.
+ *
+ * The queue is sized for the most that is ever queued at once (see
+ * project.c). If it is full, eeprom_queue_write() waits for room.
+ */
+
+#ifndef EEPROM_QUEUE_H_
+#define EEPROM_QUEUE_H_
+
+#include <stdint.h>
+
+/* Maximum number of bytes, and of runs of bytes, waiting to be written */
+#define EEPROM_QUEUE_SIZE 152
+#define EEPROM_QUEUE_RUNS 16
+
+/* Queue the given bytes to be written to EEPROM starting at the given 
+ * address. Returns straight away unless the queue doesn't have room, in
+ * which case we wait for earlier bytes to be written (interrupts must 
+ * be enabled).
+ */
+void eeprom_queue_write(uint16_t address, const void* data, uint8_t length);
+
+/* Return the number of bytes still waiting to be written.
+ */
+uint8_t eeprom_queue_pending(void);
+
+/* Return the number of bytes which can be queued without waiting (at 
+ * least, if they are for consecutive addresses).
+ */
+uint8_t eeprom_queue_space(void);
+
+/* Wait until all queued bytes have been written (interrupts must be 
+ * enabled).
+ */
+void eeprom_queue_flush(void);
+
+#endif /* EEPROM_QUEUE_H_ */
@@ -0,0 +1,112 @@
+/*
+ * eeprom_store.c
+ *
+ * Author: Elliot Randall
+ *
+ * See eeprom_store.h for details.
+ */
+
+#include <avr/eeprom.h>
+#include <util/crc16.h>
+
+#include "eeprom_store.h"
+#include "eeprom_queue.h"
+
+typedef struct {
+	uint8_t version;
+	uint8_t sequence;
+	uint8_t length;
+	uint8_t crc[2];		// CRC of the fields above and the record (low
+						// byte first)
+} StoreHeader;
+
+#define SLOT_OFFSET(slot) (STORE_ADDRESS + (uint16_t)(slot) * STORE_SLOT_SIZE)
+#define SLOT_ADDRESS(slot) ((uint8_t*)(uintptr_t)SLOT_OFFSET(slot))
+
+/* Slot and sequence number of the latest record. The next save goes to
+ * the slot after this one.
+ */
+static uint8_t latest_slot = STORE_SLOTS - 1;
+static uint8_t latest_sequence;
+
+static uint16_t header_crc(const StoreHeader* header) {
+	uint16_t crc = 0xFFFF;
+	crc = _crc16_update(crc, header->version);
+	crc = _crc16_update(crc, header->sequence);
+	crc = _crc16_update(crc, header->length);
+	return crc;
+}
+
+/* Return 1 if the given slot holds a valid record with the given version
+ * and length, and fill in its header.
+ */
+static uint8_t slot_valid(uint8_t slot, uint8_t version, uint8_t length,
+		StoreHeader* header) {
+	uint8_t* address = SLOT_ADDRESS(slot);
+	eeprom_read_block(header, address, STORE_HEADER_SIZE);
+	if(header->version != version || header->length != length) {
+		return 0;
+	}
+	uint16_t crc = header_crc(header);
+	address += STORE_HEADER_SIZE;
+	for(uint8_t i = 0; i < length; i++) {
+		crc = _crc16_update(crc, eeprom_read_byte(address++));
+	}
+	return crc == (header->crc[0] | (header->crc[1] << 8));
+}
+
+uint8_t store_load(uint8_t version, void* data, uint8_t length) {
+	StoreHeader header;
+	uint8_t found = 0;
+	
+	if(length > STORE_MAX_LENGTH) {
+		return 0;
+	}
+	// Make sure any saves still being written have finished
+	eeprom_queue_flush();
+	for(uint8_t slot = 0; slot < STORE_SLOTS; slot++) {
+		if(!slot_valid(slot, version, length, &header)) {
+			continue;
+		}
+		// Sequence numbers wrap around, so compare them by difference
+		if(!found || (int8_t)(header.sequence - latest_sequence) > 0) {
+			latest_slot = slot;
+			latest_sequence = header.sequence;
+			found = 1;
+		}
+	}
+	if(found) {
+		eeprom_read_block(data, SLOT_ADDRESS(latest_slot) + STORE_HEADER_SIZE,
+				length);
+	}
+	return found;
+}
+
+void store_save(uint8_t version, const void* data, uint8_t length) {
+	StoreHeader header;
+	
+	if(length > STORE_MAX_LENGTH) {
+		return;
+	}
+	uint8_t slot = (latest_slot + 1) % STORE_SLOTS;
+	header.version = version;
+	header.sequence = latest_sequence + 1;
+	header.length = length;
+	uint16_t crc = header_crc(&header);
+	for(uint8_t i = 0; i < length; i++) {
+		crc = _crc16_update(crc, ((const uint8_t*)data)[i]);
+	}
+	header.crc[0] = crc & 0xFF;
+	header.crc[1] = crc >> 8;
+	
+	/* Write the record before the header. Until the header is written, 
+	 * the CRC won't match, so an interrupted save leaves the slot 
+	 * invalid and the previous record is still the latest. The bytes are
+	 * written in the background (in order) by the EEPROM queue.
+	 */
+	eeprom_queue_write(SLOT_OFFSET(slot) + STORE_HEADER_SIZE, data, length);
+	eeprom_queue_write(SLOT_OFFSET(slot), &header, STORE_HEADER_SIZE);
+	
+	latest_slot = slot;
+	latest_sequence = header.sequence;
+}
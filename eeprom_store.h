@@ -0,0 +1,45 @@
+/*
+ * eeprom_store.h
+ *
+ * Author: Elliot Randall
+ *
+ * Stores a record (up to STORE_MAX_LENGTH bytes) in EEPROM so that it 
+ * survives being written to many times and being interrupted part way
+ * through a write (e.g. by a reset).
+ *
+ * Each save goes to the next of STORE_SLOTS slots in turn, spreading the
+ * wear across them. A slot holds a header (format version, sequence 
+ * number, length and a CRC of the rest) followed by the record, and 
+ * only bytes that differ from what is already in the slot are written.
+ * Saves are written in the background (see eeprom_queue.h).
+ * Loading picks the valid slot with the latest sequence number, so if
+ * a save doesn't complete, the previous record is loaded.
+ */
+
+#ifndef EEPROM_STORE_H_
+#define EEPROM_STORE_H_
+
+#include <stdint.h>
+
+/* The store occupies STORE_SLOTS * STORE_SLOT_SIZE bytes of EEPROM from
+ * STORE_ADDRESS.
+ */
+#define STORE_ADDRESS 256
+#define STORE_SLOTS 4
+#define STORE_SLOT_SIZE 64
+#define STORE_HEADER_SIZE 5
+#define STORE_MAX_LENGTH (STORE_SLOT_SIZE - STORE_HEADER_SIZE)
+
+/* Load the latest saved record into data. Returns 1 if a valid record
+ * with the given version and length was found, 0 otherwise (data is 
+ * then left unchanged). Should be called before store_save() so that
+ * saves continue on from the latest slot.
+ */
+uint8_t store_load(uint8_t version, void* data, uint8_t length);
+
+/* Save the given record (length up to STORE_MAX_LENGTH) to the next 
+ * slot.
+ */
+void store_save(uint8_t version, const void* data, uint8_t length);
+
+#endif /* EEPROM_STORE_H_ */
@@ -15,12 +15,16 @@
 #include "score.h"
 #include "ledmatrix.h"
 #include "terminalio.h"
+#include "serialio.h"
 #include "timer2.h"
+#include "input.h"
+#include "timer0.h"
 #include <avr/io.h>
 #include <avr/eeprom.h>
 #include <avr/pgmspace.h> // For PSTR
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 /*
  * Function prototypes.
@@ -35,58 +39,109 @@
  * available functions.
  */
 
-static void check_for_completed_rows(void);
-static uint8_t add_random_block(void);
-static uint8_t block_collides(FallingBlock block);
-static void remove_current_block_from_board_display(void);
-static void add_current_block_to_board_display(void);
-int current_speed = 600; 
+static void check_for_completed_rows(GameState* game);
+static uint8_t add_random_block(GameState* game);
+static uint8_t take_next_block(GameState* game);
+static void show_next_blocks(const GameState* game);
+static uint8_t block_collides(const GameState* game, FallingBlock block);
+static uint8_t block_dropped_straight(const GameState* game, 
+		FallingBlock block);
+static void add_current_block_to_board_display(GameState* game);
+static rowtype block_row_bits(const FallingBlock* block, rownum row);
+static FallingBlock landing_position(const GameState* game, 
+		FallingBlock block);
+static void mark_new_block(GameState* game, const FallingBlock* block);
+static void mark_block_move(GameState* game, const FallingBlock* old_block,
+		const FallingBlock* new_block);
+static void mark_changed_rows(GameState* game, const FallingBlock* old_block,
+		const FallingBlock* new_block);
+static void compose_row(const GameState* game, rownum row, 
+		const FallingBlock* ghost, MatrixColumn column);
+static void overlay_block(const FallingBlock* block, rownum row, 
+		PixelColour colour, PixelColour* cells, uint8_t num_cells);
+static uint8_t get_snapshot_cell(const uint8_t* cells, uint8_t col);
+static void set_snapshot_cell(uint8_t* cells, uint8_t col, uint8_t cell);
+static void play_game_sound(const GameState* game, uint8_t effect);
 
 /*
- * Global variables.
- * We keep two representations of the board:
- *	- an array of "rowtype" rows (which has one bit per column
- *    which indicates whether the given position is occupied or not). This 
- *    representation does NOT include the current dropping block.
- *  - an array of corresponding LED matrix columns (a row of the game
- *    will be displayed on a column). This records colour information
- *    for each position. This DOES include the current dropping block.
- * For both representations, the array is indexed from row 0.
- * For "board" - column 0 (bit 0) is on the right
- * For "board_display" - element 0 within each MatrixColumn is on the left
+ * Gravity speed curve. The time (in ms) between gravity drops, indexed
+ * by the number of rows cleared. Each cleared row scales the interval
+ * by a factor 1.8% smaller than the last (0.982, 0.964, 0.946 ...) until
+ * it gets below 200ms, after which it stays the same. The table is 
+ * worked out by the compiler using integer arithmetic - change 
+ * INITIAL_DROP_INTERVAL or SPEED_FACTOR to tune the curve.
  */
-rowtype    board[BOARD_ROWS];
-MatrixColumn board_display[BOARD_ROWS];
-FallingBlock current_block;	// Current dropping block - there will 
-							// always be one if the game is being played
-							
-FallingBlock preview_block; //the preview block
-uint8_t cleared_count = 0;
-volatile uint8_t seven_seg_cc = 0; 
-uint8_t seven_seg_data[10] = {63,6,91,79,102,109,125,7,127,111}; 
+#define INITIAL_DROP_INTERVAL 600UL
+#define SPEED_FACTOR(level) (1000UL - 18UL * (level))	// Parts per 1000
+#define DROP_INTERVAL_0 INITIAL_DROP_INTERVAL
+#define DROP_INTERVAL_1 (DROP_INTERVAL_0 * SPEED_FACTOR(1) / 1000)
+#define DROP_INTERVAL_2 (DROP_INTERVAL_1 * SPEED_FACTOR(2) / 1000)
+#define DROP_INTERVAL_3 (DROP_INTERVAL_2 * SPEED_FACTOR(3) / 1000)
+#define DROP_INTERVAL_4 (DROP_INTERVAL_3 * SPEED_FACTOR(4) / 1000)
+#define DROP_INTERVAL_5 (DROP_INTERVAL_4 * SPEED_FACTOR(5) / 1000)
+#define DROP_INTERVAL_6 (DROP_INTERVAL_5 * SPEED_FACTOR(6) / 1000)
+#define DROP_INTERVAL_7 (DROP_INTERVAL_6 * SPEED_FACTOR(7) / 1000)
+#define DROP_INTERVAL_8 (DROP_INTERVAL_7 * SPEED_FACTOR(8) / 1000)
+#define DROP_INTERVAL_9 (DROP_INTERVAL_8 * SPEED_FACTOR(9) / 1000)
+#define DROP_INTERVAL_10 (DROP_INTERVAL_9 * SPEED_FACTOR(10) / 1000)
+#define DROP_INTERVAL_11 (DROP_INTERVAL_10 * SPEED_FACTOR(11) / 1000)
+static const uint16_t drop_interval[] PROGMEM = {
+	DROP_INTERVAL_0, DROP_INTERVAL_1, DROP_INTERVAL_2, DROP_INTERVAL_3,
+	DROP_INTERVAL_4, DROP_INTERVAL_5, DROP_INTERVAL_6, DROP_INTERVAL_7,
+	DROP_INTERVAL_8, DROP_INTERVAL_9, DROP_INTERVAL_10, DROP_INTERVAL_11
+};
+_Static_assert(sizeof(drop_interval) / sizeof(drop_interval[0]) == 
+		NUM_SPEED_LEVELS, "NUM_SPEED_LEVELS (game.h) doesn't match the table");
+
+/*
+ * If SHOW_GHOST_BLOCK is 1, the position the falling block would land 
+ * in is shown in GHOST_COLOUR (a dim yellow) under the falling block.
+ */
+#define SHOW_GHOST_BLOCK 0
+#define GHOST_COLOUR 0x11
+
 int is_running = 0; 
-float acceleration = 1; 
 
 /* 
  * Initialise board - all the row data will be empty (0) and we
  * create an initial random block and add it to the top of the board.
  */
-void init_game(void) {	
-	// Clear the LED matrix
-	ledmatrix_clear();
-
-	for(uint8_t row=0; row < BOARD_ROWS; row++) {
-		board[row] = 0;
-		for(uint8_t col=0; col < MATRIX_NUM_ROWS; col++) {
-			board_display[row][col] = 0;
+void init_game(GameState* game, uint32_t seed) {	
+	// Clear the LED matrix and terminal
+	if(game->visible) {
+		ledmatrix_clear();
+		clear_terminal();
+	}
+
+	for(rownum row=0; row < BOARD_ROWS; row++) {
+		game->board[row] = 0;
+		for(uint8_t col=0; col < BOARD_WIDTH; col++) {
+			game->board_display[row][col] = 0;
 		}
 	}
+	game->rows_to_update = 0;
+	game->game_over = 0;
+	
+	// Start a fresh sequence of blocks and choose the upcoming blocks. 
+	// The first of these becomes the current block when the first block
+	// is added.
+	seed_block_generator(&game->random_state, seed);
+	for(uint8_t i = 0; i < NUM_NEXT_BLOCKS; i++) {
+		game->next_blocks[i] = random_block_number(&game->random_state);
+	}
+	game->next_block_index = 0;
+	
+	// No rows cleared yet - this also puts gravity back to its 
+	// initial speed
+	set_cleared_count(game, 0);
+	init_score(game);
+	
 	// Adding a random block will update the "current_block" and 
 	// add it to the board.	With an empty board this will always
 	// succeed so we ignore the return value - this is indicated 
 	// by the (void) cast. This function will update the display
 	// for the required rows.
-	(void)add_random_block();
+	(void)add_random_block(game);
 }
 
 int get_is_running(void) {
@@ -97,36 +152,85 @@ void set_is_running(void) {
 	is_running = 1; 
 }
 
-void set_cleared_count(uint8_t value) {
-	cleared_count = value; 
+void set_cleared_count(GameState* game, uint8_t value) {
+	if(value > 99) {
+		value = 99;
+	}
+	game->cleared_count = binary_to_bcd(value); 
 }
 
-void accelerate(void) {
-	if (acceleration > 0.3) {
-		acceleration = acceleration - 0.018; 
-	} else {
-		acceleration = acceleration;//0.3; 
+uint8_t get_cleared_count(const GameState* game) {
+	return (game->cleared_count >> 4) * 10 + (game->cleared_count & 0x0F);
+}
+
+uint8_t get_cleared_count_bcd(const GameState* game) {
+	return game->cleared_count;
+}
+
+uint8_t get_speed_level(const GameState* game) {
+	uint8_t level = get_cleared_count(game);
+	if(level >= NUM_SPEED_LEVELS) {
+		level = NUM_SPEED_LEVELS - 1;
 	}
-	current_speed = current_speed * acceleration; 	
+	return level;
 }
 
-float get_acceleration(void) {
-	return current_speed;//return acceleration; 
+uint8_t get_next_block(const GameState* game, uint8_t n) {
+	n += game->next_block_index;
+	if(n >= NUM_NEXT_BLOCKS) {
+		n -= NUM_NEXT_BLOCKS;
+	}
+	return game->next_blocks[n];
 }
 
-void reset_current_speed(void) {
-	current_speed = 600; 
+uint16_t get_drop_interval(const GameState* game) {
+	return pgm_read_word(&drop_interval[get_speed_level(game)]);
+}
+
+/* 
+ * Mark the rows given as needing to be copied to the LED display. The
+ * copy is done by flush_display(), so several changes to the same rows
+ * only cost one update. Rows above the part of the board which is 
+ * displayed are ignored.
+ */
+void update_rows_on_display(GameState* game, rownum row_start, 
+		rownum num_rows) {
+#if DISPLAY_FIRST_ROW > 0
+	if(row_start + num_rows <= DISPLAY_FIRST_ROW) {
+		return;
+	}
+	if(row_start < DISPLAY_FIRST_ROW) {
+		num_rows -= DISPLAY_FIRST_ROW - row_start;
+		row_start = DISPLAY_FIRST_ROW;
+	}
+#endif
+	if(num_rows == 0) {
+		return;
+	}
+	game->rows_to_update |= (uint16_t)(((1UL << num_rows) - 1) << 
+			(row_start - DISPLAY_FIRST_ROW));
 }
 
 /* 
- * Copy board to LED display for the rows given.
+ * Copy board to LED display for the rows which have changed, with the
+ * falling block (and its ghost) drawn over the fixed blocks.
  * Note that each "row" in the board corresponds to a column for
  * the LED matrix.
  */
-void update_rows_on_display(uint8_t row_start, uint8_t num_rows) {
-	uint8_t row_end = row_start + num_rows - 1;
-	for(uint8_t row_num = row_start; row_num <= row_end; row_num++) {
-		ledmatrix_update_column(row_num, board_display[row_num]);
+void flush_display(GameState* game) {
+	MatrixColumn column;
+	// The ghost is only drawn if SHOW_GHOST_BLOCK is 1, but is always
+	// set so compose_row() is never given an uninitialised block
+	FallingBlock ghost = game->current_block;
+	if(SHOW_GHOST_BLOCK && game->rows_to_update) {
+		ghost = landing_position(game, game->current_block);
+	}
+	for(uint8_t col_num = 0; game->rows_to_update != 0; col_num++) {
+		if(game->rows_to_update & 1) {
+			compose_row(game, DISPLAY_FIRST_ROW + col_num, &ghost, column);
+			ledmatrix_update_column(col_num, column);
+		}
+		game->rows_to_update >>= 1;
 	}
 }
 
@@ -137,11 +241,11 @@ void update_rows_on_display(uint8_t row_start, uint8_t num_rows) {
  * (2) the board contains no blocks in that position.
  * Returns 1 if move successful, 0 otherwise.
  */
-uint8_t attempt_move(int8_t direction) {	
+uint8_t attempt_move(GameState* game, int8_t direction) {	
 	// Make a copy of the current block - we carry out the 
 	// operations on the copy and copy it over to the current_block
 	// if all is successful
-	FallingBlock tmp_block = current_block;
+	FallingBlock tmp_block = game->current_block;
 	
 	if(direction == MOVE_LEFT) {
 		if(!move_block_left(&tmp_block)) {
@@ -158,21 +262,16 @@ uint8_t attempt_move(int8_t direction) {
 	
 	// The temporary block wasn't at the edge and has been moved
 	// Now check whether it collides with any blocks on the board.
-	if(block_collides(tmp_block)) {
+	if(block_collides(game, tmp_block)) {
 		// Block will collide with other blocks so the move can't be
 		// made.
 		return 0;
 	}
 	
-	// Block won't collide with other blocks so we can lock in the move.
-	// First remove the current block from the display, update the current
-	// block, then add it back to the board display
-	remove_current_block_from_board_display();
-	current_block = tmp_block;
-	add_current_block_to_board_display();
-	
-	// Update the rows which are affected
-	update_rows_on_display(current_block.row, current_block.height);
+	// Block won't collide with other blocks so we can lock in the move,
+	// updating the rows which are affected
+	mark_block_move(game, &game->current_block, &tmp_block);
+	game->current_block = tmp_block;
 	return 1;
 }
 
@@ -182,12 +281,12 @@ uint8_t attempt_move(int8_t direction) {
  * the board. Returns 1 if drop succeeded,  0 otherwise. 
  * (If the drop fails, the caller should add the block to the board.)
 */
-uint8_t attempt_drop_block_one_row(void) {
+uint8_t attempt_drop_block_one_row(GameState* game) {
 	/*
 	 * Check if the block has reached the bottom of the board.
 	 * If so, do nothing and return false
 	 */
-	if(current_block.row + current_block.height >= BOARD_ROWS) {
+	if(game->current_block.row + game->current_block.height >= BOARD_ROWS) {
 		return 0;
 	}
 	
@@ -195,21 +294,17 @@ uint8_t attempt_drop_block_one_row(void) {
 	 * Move it down 1 row and check whether it collides with
 	 * any fixed blocks.
 	 */
-	FallingBlock tmp_block = current_block;
+	FallingBlock tmp_block = game->current_block;
 	tmp_block.row += 1;
-	if(block_collides(tmp_block)) {
+	if(block_collides(game, tmp_block)) {
 		// Block will collide if moved down - so we can't move it
 		return 0;
 	}
 	
-	// Move would succeed - so we make it happen
-	remove_current_block_from_board_display();
-	current_block = tmp_block;
-	add_current_block_to_board_display();
-	
-	// Update the rows which are affected - starting from the row before
-	// where the current block is.
-	update_rows_on_display(current_block.row - 1, current_block.height + 1);
+	// Move would succeed - so we make it happen, updating the rows which
+	// are affected
+	mark_block_move(game, &game->current_block, &tmp_block);
+	game->current_block = tmp_block;
 	
 	// Move was successful - indicate so
 	return 1;
@@ -221,11 +316,11 @@ uint8_t attempt_drop_block_one_row(void) {
  * blocks the rotation or the block is too close to the left edge to 
  * rotate).
  */
-uint8_t attempt_rotation(void) {
+uint8_t attempt_rotation(GameState* game) {
 	// Make a copy of the current block - we carry out the
 	// operations on the copy and copy it back to the current_block
 	// if all is successful
-	FallingBlock tmp_block = current_block;
+	FallingBlock tmp_block = game->current_block;
 	
 	if(!rotate_block(&tmp_block)) {
 		// Block was too far left to rotate	- abort
@@ -234,27 +329,16 @@ uint8_t attempt_rotation(void) {
 	
 	// The temporary block has been rotated. 
 	// Now check whether it collides with any blocks on the board.
-	if(block_collides(tmp_block)) {
+	if(block_collides(game, tmp_block)) {
 		// Block will collide with other blocks so the rotate can't be
 		// made.
 		return 0;
 	}
 	
-	// Block won't collide with other blocks so we can lock in the move.
-	// First determine the number of rows affected (to be redrawn) -
-	// will be maximum of those in block before and after rotation
-	uint8_t rows_affected = tmp_block.height;
-	if(current_block.height > tmp_block.height) {
-		rows_affected = current_block.height;
-	}	
-	
-	// Second remove the current block from the display, update the current
-	// block to the rotated version, then add it back to the board display
-	remove_current_block_from_board_display();
-	current_block = tmp_block;
-	add_current_block_to_board_display();
-
-	update_rows_on_display(current_block.row, rows_affected);
+	// Block won't collide with other blocks so we can lock in the move,
+	// updating the rows which are affected
+	mark_block_move(game, &game->current_block, &tmp_block);
+	game->current_block = tmp_block;
 	
 	// Rotation has happened - return true
 	return 1;
@@ -262,31 +346,199 @@ uint8_t attempt_rotation(void) {
 
 /*
  * Add current block to board at its current position. We do this using a
- * bitwise OR for each row that contains the block.	No display update is
- * required. We then attempt to add a new block to the top of the board.
- * If this suceeds, we return 1, otherwise we return 0 (meaning game over).
+ * bitwise OR for each row that contains the block, and copy its colour
+ * to the board display. No display update is required (the block looks
+ * the same fixed as falling). We then attempt to add a new block to the
+ * top of the board. If this suceeds, we return 1, otherwise we return 0
+ * (meaning game over).
  */
-uint8_t fix_block_to_board_and_add_new_block(void) {
-	for(uint8_t row = 0; row < current_block.height; row++) {
-		uint8_t board_row = current_block.row + row;
-		board[board_row] |= 
-				(current_block.pattern[row]	<< current_block.column);
-	}
-	check_for_completed_rows();
-	add_to_score(1); 
+uint8_t fix_block_to_board_and_add_new_block(GameState* game) {
+	uint8_t cleared_before = game->cleared_count;
+	if(game->lock_handler) {
+		game->lock_handler(&game->current_block, 
+				block_dropped_straight(game, game->current_block));
+	}
+	for(uint8_t row = 0; row < game->current_block.height; row++) {
+		rownum board_row = game->current_block.row + row;
+		game->board[board_row] |= (rowtype)game->current_block.pattern[row] 
+				<< game->current_block.column;
+	}
+	add_current_block_to_board_display(game);
+	check_for_completed_rows(game);
+	add_to_score(game, 0x1); 
+	if(game->cleared_count != cleared_before) {
+		play_game_sound(game, SOUND_LINE_CLEAR);
+	} else {
+		play_game_sound(game, SOUND_LOCK);
+	}
 	//printf("%d\n", get_score()); 
-	return add_random_block();
+	return add_random_block(game);
 }
 
+/*
+ * Move the current block straight to the given rotation, column and row
+ * (or, if row is negative, as far down as it will drop from the top of
+ * the board) and fix it to the board. This is how placements are
+ * replayed from a placement log (see placement_log.h), so the block 
+ * doesn't have to be able to get there by moves and drops.
+ */
+uint8_t place_block(GameState* game, uint8_t rotation, uint8_t column, 
+		int16_t row) {
+	FallingBlock block = game->current_block;
+	
+	while(block.rotation != rotation) {
+		if(!rotate_block(&block)) {
+			return 0;
+		}
+	}
+	while(block.column < column && move_block_left(&block)) {
+		;
+	}
+	while(block.column > column && move_block_right(&block)) {
+		;
+	}
+	if(row < 0) {
+		block.row = 0;
+		while(block.row + block.height < BOARD_ROWS) {
+			block.row++;
+			if(block_collides(game, block)) {
+				block.row--;
+				break;
+			}
+		}
+	} else {
+		block.row = row;
+	}
+	if(block.column != column || block.row + block.height > BOARD_ROWS ||
+			block_collides(game, block)) {
+		return 0;
+	}
+	
+	mark_block_move(game, &game->current_block, &block);
+	game->current_block = block;
+	return fix_block_to_board_and_add_new_block(game);
+}
+
+void set_lock_handler(GameState* game, LockHandler handler) {
+	game->lock_handler = handler;
+}
 
-void update_seven_seg() {
-	seven_seg_cc = seven_seg_cc ^ 1;
-	if (seven_seg_cc == 0) {
-		PORTC = seven_seg_data[(cleared_count)%10];
-		} else {
-		PORTC = seven_seg_data[(cleared_count)/10];
+void save_game_snapshot(const GameState* game, GameSnapshot* snapshot) {
+	snapshot->score = get_score(game);
+	snapshot->random_state = game->random_state;
+	for(rownum row = 0; row < BOARD_ROWS; row++) {
+		for(uint8_t i = 0; i < SNAPSHOT_ROW_BYTES; i++) {
+			snapshot->cells[row][i] = 0;
+		}
+		for(uint8_t col = 0; col < BOARD_WIDTH; col++) {
+			if(!(game->board[row] & ((rowtype)1 << col))) {
+				continue;
+			}
+			// Find which block's colour this position has
+			PixelColour colour = game->board_display[row][BOARD_WIDTH - col - 1];
+			uint8_t blocknum = 0;
+			while(blocknum < NUM_BLOCKS_IN_LIBRARY - 1 && 
+					block_colour(blocknum) != colour) {
+				blocknum++;
+			}
+			set_snapshot_cell(snapshot->cells[row], col, blocknum + 1);
+		}
+	}
+	for(uint8_t i = 0; i < SNAPSHOT_BLOCK_BYTES; i++) {
+		snapshot->blocks[i] = 0;
 	}
-	PORTA = (seven_seg_cc << PINA7);// PORTA = seven_seg_cc; 
+	for(uint8_t i = 0; i <= NUM_NEXT_BLOCKS; i++) {
+		uint8_t blocknum = i ? get_next_block(game, i - 1) : 
+				game->current_block.blocknum;
+		snapshot->blocks[i / 2] |= blocknum << (4 * (i % 2));
+	}
+	snapshot->cleared_count = get_cleared_count(game);
+}
+
+uint8_t restore_game_snapshot(GameState* game, 
+		const GameSnapshot* snapshot) {
+	uint8_t blocknums[NUM_NEXT_BLOCKS + 1];
+	for(uint8_t i = 0; i <= NUM_NEXT_BLOCKS; i++) {
+		blocknums[i] = (snapshot->blocks[i / 2] >> (4 * (i % 2))) & 0x0F;
+		if(blocknums[i] >= NUM_BLOCKS_IN_LIBRARY) {
+			return 0;
+		}
+	}
+	
+	if(game->visible) {
+		ledmatrix_clear();
+		clear_terminal();
+	}
+	game->game_over = 0;
+	for(rownum row = 0; row < BOARD_ROWS; row++) {
+		game->board[row] = 0;
+		for(uint8_t col = 0; col < BOARD_WIDTH; col++) {
+			uint8_t cell = get_snapshot_cell(snapshot->cells[row], col);
+			PixelColour colour = 0;
+			if(cell > NUM_BLOCKS_IN_LIBRARY) {
+				return 0;
+			} else if(cell) {
+				game->board[row] |= (rowtype)1 << col;
+				colour = block_colour(cell - 1);
+			}
+			game->board_display[row][BOARD_WIDTH - col - 1] = colour;
+		}
+	}
+	game->random_state = snapshot->random_state;
+	set_cleared_count(game, snapshot->cleared_count);
+	set_score(game, snapshot->score);
+	
+	// The snapshot was taken just after the current block was added to 
+	// the top of the board
+	game->current_block = new_block(blocknums[0]);
+	for(uint8_t i = 0; i < NUM_NEXT_BLOCKS; i++) {
+		game->next_blocks[i] = blocknums[i + 1];
+	}
+	game->next_block_index = 0;
+	show_next_blocks(game);
+	if(block_collides(game, game->current_block)) {
+		return 0;
+	}
+	update_rows_on_display(game, 0, BOARD_ROWS);
+	return 1;
+}
+
+/*
+ * Apply a game action (see input.h) to the current block. Drops that
+ * fail fix the block to the board and add a new block. Returns 0 if
+ * this ends the game, 1 otherwise.
+ */
+uint8_t apply_game_action(GameState* game, uint8_t action) {
+	switch(action) {
+		case INPUT_MOVE_LEFT:
+			(void)attempt_move(game, MOVE_LEFT);
+			break;
+		case INPUT_MOVE_RIGHT:
+			(void)attempt_move(game, MOVE_RIGHT);
+			break;
+		case INPUT_ROTATE:
+			if(attempt_rotation(game)) {
+				play_game_sound(game, SOUND_ROTATE);
+			}
+			break;
+		case INPUT_HARD_DROP: {
+			// Drop straight to where the block lands, so only the rows 
+			// it leaves and lands in are redrawn
+			FallingBlock landed = landing_position(game, game->current_block);
+			mark_block_move(game, &game->current_block, &landed);
+			game->current_block = landed;
+			play_game_sound(game, SOUND_HARD_DROP);
+		}
+			break;
+		case INPUT_SOFT_DROP:
+		case INPUT_GRAVITY_DROP:
+			if(!attempt_drop_block_one_row(game)) {
+				// Drop failed - fix block to board and add new block
+				return fix_block_to_board_and_add_new_block(game);
+			}
+			break;
+	}
+	return 1;
 }
 
 //////////////////////////////////////////////////////////////////////////
@@ -300,28 +552,34 @@ void update_seven_seg() {
  * to a column on the LED matrix.)
  */
 
-static void check_for_completed_rows(void) {
+static void check_for_completed_rows(GameState* game) {
 	//Iterate through the board rows
 	
-	for (int i = 0; i < BOARD_ROWS; i++) {
-		if (board[i] == ((1 << BOARD_WIDTH) - 1)) {
-			for (int k = i; k >= 1; k--) { // for all the rows less than i
+	for (rownum i = 0; i < BOARD_ROWS; i++) {
+		if (game->board[i] == FULL_ROW) {
+			for (rownum k = i; k >= 1; k--) { // for all the rows less than i
 				//printf("Moved: %d, to: %d\n", k-1, k); 
-				copy_matrix_column(board_display[k-1], board_display[k]);
-				board[k] = board[k-1];  
-				ledmatrix_update_all(board_display); 
-				//ledmatrix_update_all(board);
+				// Empty rows moving down don't change the display
+				if(game->board[k] | game->board[k-1]) {
+					update_rows_on_display(game, k, 1);
+				}
+				memcpy(game->board_display[k], game->board_display[k-1], 
+						sizeof(BoardDisplayRow));
+				game->board[k] = game->board[k-1];  
+			}
+			if(game->board[0]) {
+				update_rows_on_display(game, 0, 1);
 			}
 			//printf("Make the Top Empty"); 
-			for (int j = 0; j < 8/*BOARD_ROWS*/; j++) {
-				board_display[0][j] = 0; 
+			game->board[0] = 0;
+			for (uint8_t j = 0; j < BOARD_WIDTH; j++) {
+				game->board_display[0][j] = 0; 
 			}
-			accelerate(); 
-			add_to_score(100); 
-			if(cleared_count > 99) {
-				cleared_count = 99; 
-			} else {
-				cleared_count += 1; 
+			add_to_score(game, 0x100); 
+			// Count the row in BCD, stopping at 99
+			if(game->cleared_count != 0x99) {
+				game->cleared_count += 
+						((game->cleared_count & 0x0F) == 9) ? 0x10 - 9 : 1; 
 			}
 			
 			
@@ -370,109 +628,75 @@ static void check_for_completed_rows(void) {
  */
 
 
-int gameStarted = 0; 
-
-static uint8_t add_random_block(void) {
+static uint8_t add_random_block(GameState* game) {
+	game->current_block = new_block(take_next_block(game));
+	show_next_blocks(game);
 	
-	
-		clear_terminal();
-		move_cursor(0,0);
-	if (gameStarted == 0) {
-		current_block = generate_random_block(); 
-		preview_block = generate_random_block();//current_block; 
-		gameStarted += 1; 
-	} else {
-		current_block = preview_block;
-		preview_block = generate_random_block(); 
-	}
- 
-	if (preview_block.blocknum == 0) {
-		printf_P(PSTR("NEXT BLOCK: "));
-		set_display_attribute(BG_RED);
-		printf_P(PSTR(" \n\n")); 
-		normal_display_mode();
-	} else if (preview_block.blocknum == 1) {
-		printf_P(PSTR("NEXT BLOCK: "));
-		set_display_attribute(BG_RED);
-		printf_P(PSTR(" \n")); 
-		normal_display_mode(); 
-		printf_P(PSTR("            "));
-		set_display_attribute(BG_RED);
-		printf_P(PSTR(" \n"));
-		normal_display_mode();
-		printf_P(PSTR("            ")); 
-		set_display_attribute(BG_RED);
-		printf_P(PSTR(" \n"));
-		normal_display_mode();
-	} else if (preview_block.blocknum == 2) {
-		printf_P(PSTR("NEXT BLOCK: "));
-		set_display_attribute(BG_GREEN);
-		printf_P(PSTR("  \n")); 
-		normal_display_mode();
-		printf_P(PSTR("            "));
-		set_display_attribute(BG_GREEN);
-		printf_P(PSTR("  \n\n"));
-		normal_display_mode();
-	} else if (preview_block.blocknum == 3) {
-		printf_P(PSTR("NEXT BLOCK:  "));
-		set_display_attribute(BG_YELLOW);
-		printf_P(PSTR(" \n"));
-		normal_display_mode();
-		printf_P(PSTR("            "));
-		set_display_attribute(BG_YELLOW);
-		printf_P(PSTR("   \n"));  
-		normal_display_mode();
-	} else if (preview_block.blocknum == 4) {
-		printf_P(PSTR("NEXT BLOCK:   "));
-		set_display_attribute(BG_MAGENTA);
-		printf_P(PSTR(" \n"));
-		normal_display_mode();
-		printf_P(PSTR("            "));
-		set_display_attribute(BG_MAGENTA);
-		printf_P(PSTR("   \n\n"));
-		normal_display_mode();
-		
-	}
-	
-	
-	
-	//current_block = generate_random_block();
 	// Check if the block will collide with the fixed blocks on the board
-	if(block_collides(current_block)) {
-		/* Block will collide. We don't add the block - just return 0 - 
-		 * the game is over.
+	if(block_collides(game, game->current_block)) {
+		/* Block will collide. We don't add the block (or show it) - just
+		 * return 0 - the game is over.
 		 */
+		game->game_over = 1;
 		return 0;
 	}
 	
 	/* Block won't collide with fixed blocks on the board so 
-	 * we update our board display.
+	 * we update the display for the rows which are affected.
 	 */
-	add_current_block_to_board_display();
-	//add_preview_block_to_board_display();
-	
-	// Update the display for the rows which are affected
-	update_rows_on_display(current_block.row, current_block.height);
+	mark_new_block(game, &game->current_block);
 	
 	// The addition succeeded - return true
 	return 1;
 }
 
+/*
+ * Take the next block from the upcoming blocks and return its number. 
+ * A new block is chosen to go on the end of the queue in its place.
+ */
+static uint8_t take_next_block(GameState* game) {
+	uint8_t blocknum = game->next_blocks[game->next_block_index];
+	game->next_blocks[game->next_block_index] = 
+			random_block_number(&game->random_state);
+	if(++game->next_block_index == NUM_NEXT_BLOCKS) {
+		game->next_block_index = 0;
+	}
+	return blocknum;
+}
+
+/*
+ * Show the upcoming blocks on the terminal, next block first. Each 
+ * block's preview is prepared in program memory (see blocks.h), so 
+ * this is just a write of each to the serial port.
+ */
+static const char next_blocks_label[] PROGMEM = "\x1b[3;1HNEXT BLOCKS: ";
+
+static void show_next_blocks(const GameState* game) {
+	if(!game->visible) {
+		return;
+	}
+	serial_write_P(next_blocks_label);
+	for(uint8_t i = 0; i < NUM_NEXT_BLOCKS; i++) {
+		serial_write_P(block_preview(get_next_block(game, i)));
+	}
+}
+
 
 /*
  * Check whether the given block collides (intersects with) with
  * the fixed blocks on the board. Return 1 if it does collide, 0
  * otherwise.
  */
-static uint8_t block_collides(FallingBlock block) {
+static uint8_t block_collides(const GameState* game, FallingBlock block) {
 	// We work out the bit patterns for the block in each row
 	// and use a bitwise AND to determine whether there is an
 	// intersection or not
 	for(uint8_t row = 0; row < block.height; row++) {
-		rowtype bit_pattern_for_row = block.pattern[row] << block.column;
+		rowtype bit_pattern_for_row = (rowtype)block.pattern[row] << 
+				block.column;
 		// The bit pattern to check this against will be that on the board
 		// at the position where the block is located
-		if(bit_pattern_for_row & board[block.row + row]) {
+		if(bit_pattern_for_row & game->board[block.row + row]) {
 			// This row collides - we can stop now
 			return 1;
 		}
@@ -481,37 +705,175 @@ static uint8_t block_collides(FallingBlock block) {
 }
 
 /*
- * Remove the current block from the display structure
+ * Return 1 if the given block could have dropped straight down to its
+ * position from the top of the board (i.e. it doesn't collide in any 
+ * row above) and comes to rest there, 0 otherwise.
  */
-static void remove_current_block_from_board_display(void) {
-	for(uint8_t row = 0; row < current_block.height; row++) {
-		uint8_t board_row = row + current_block.row;
-		for(uint8_t col = 0; col < current_block.width; col++) {
-			if(current_block.pattern[row] & (1 << col)) {
-				// This position in the block is occupied - zero it out
-				// in the display
-				uint8_t board_column = col + current_block.column;
-				uint8_t display_column = BOARD_WIDTH - board_column - 1;
-				board_display[board_row][display_column] = 0;
-			}
+static uint8_t block_dropped_straight(const GameState* game, 
+		FallingBlock block) {
+	rownum row = block.row;
+	if(row + block.height < BOARD_ROWS) {
+		block.row = row + 1;
+		if(!block_collides(game, block)) {
+			return 0;	// Not resting on anything
+		}
+	}
+	for(block.row = 0; block.row < row; block.row++) {
+		if(block_collides(game, block)) {
+			return 0;
 		}
 	}
+	return 1;
 }
 
 /*
- * Add the current block to the display structure
+ * Add the current block to the display structure (once it is fixed)
  */
-static void add_current_block_to_board_display(void) {
-	for(uint8_t row = 0; row < current_block.height; row++) {
-		uint8_t board_row = row + current_block.row;
-		for(uint8_t col = 0; col < current_block.width; col++) {
-			if(current_block.pattern[row] & (1 << col)) {
-				// This position in the block is occupied - add it to
-				// The board display 
-				uint8_t board_column = col + current_block.column;
-				uint8_t display_column = BOARD_WIDTH - board_column - 1;
-				board_display[board_row][display_column] = current_block.colour;
-			}
+static void add_current_block_to_board_display(GameState* game) {
+	for(uint8_t row = 0; row < game->current_block.height; row++) {
+		rownum board_row = row + game->current_block.row;
+		overlay_block(&game->current_block, board_row, 
+				game->current_block.colour, game->board_display[board_row], 
+				BOARD_WIDTH);
+	}
+}
+
+/*
+ * Return the bits the given block occupies in the given row of the board
+ * (in the same form as the board), or 0 if it isn't in that row.
+ */
+static rowtype block_row_bits(const FallingBlock* block, rownum row) {
+	if(row < block->row || row >= block->row + block->height) {
+		return 0;
+	}
+	return (rowtype)block->pattern[row - block->row] << block->column;
+}
+
+/*
+ * Return the block moved as far down as it will drop.
+ */
+static FallingBlock landing_position(const GameState* game, 
+		FallingBlock block) {
+	while(block.row + block.height < BOARD_ROWS) {
+		block.row++;
+		if(block_collides(game, block)) {
+			block.row--;
+			break;
+		}
+	}
+	return block;
+}
+
+/*
+ * Mark the rows a newly added block (and its ghost) appears in as 
+ * needing an update.
+ */
+static void mark_new_block(GameState* game, const FallingBlock* block) {
+	update_rows_on_display(game, block->row, block->height);
+	if(SHOW_GHOST_BLOCK) {
+		FallingBlock ghost = landing_position(game, *block);
+		update_rows_on_display(game, ghost.row, ghost.height);
+	}
+}
+
+/*
+ * Mark the rows which change when the falling block moves from 
+ * old_block to new_block (and its ghost moves with it) as needing an
+ * update. The fixed blocks aren't changed by a move, so these are just
+ * the rows where the block's bits differ.
+ */
+static void mark_block_move(GameState* game, const FallingBlock* old_block,
+		const FallingBlock* new_block) {
+	mark_changed_rows(game, old_block, new_block);
+	if(SHOW_GHOST_BLOCK) {
+		FallingBlock old_ghost = landing_position(game, *old_block);
+		FallingBlock new_ghost = landing_position(game, *new_block);
+		mark_changed_rows(game, &old_ghost, &new_ghost);
+	}
+}
+
+static void mark_changed_rows(GameState* game, const FallingBlock* old_block,
+		const FallingBlock* new_block) {
+	rownum first_row = old_block->row;
+	if(new_block->row < first_row) {
+		first_row = new_block->row;
+	}
+	rownum end_row = old_block->row + old_block->height;
+	if(new_block->row + new_block->height > end_row) {
+		end_row = new_block->row + new_block->height;
+	}
+	for(rownum row = first_row; row < end_row; row++) {
+		if(block_row_bits(old_block, row) != block_row_bits(new_block, row)) {
+			update_rows_on_display(game, row, 1);
 		}
 	}
 }
+
+/*
+ * Work out what the given row of the board should show on the LED 
+ * display - the fixed blocks, with the ghost (if shown) and then the 
+ * falling block drawn over them (unless the game is over). Only the
+ * first DISPLAY_WIDTH positions of the row fit on the display.
+ */
+static void compose_row(const GameState* game, rownum row, 
+		const FallingBlock* ghost, MatrixColumn column) {
+	for(uint8_t col = 0; col < MATRIX_NUM_ROWS; col++) {
+		column[col] = col < DISPLAY_WIDTH ? game->board_display[row][col] : 0;
+	}
+	if(game->game_over) {
+		return;
+	}
+	if(SHOW_GHOST_BLOCK) {
+		overlay_block(ghost, row, GHOST_COLOUR, column, DISPLAY_WIDTH);
+	}
+	overlay_block(&game->current_block, row, game->current_block.colour, 
+			column, DISPLAY_WIDTH);
+}
+
+/*
+ * Set the positions the given block occupies in the given row of the 
+ * board to the given colour in cells (the first num_cells positions of a
+ * row of the board display).
+ */
+static void overlay_block(const FallingBlock* block, rownum row, 
+		PixelColour colour, PixelColour* cells, uint8_t num_cells) {
+	rowtype bits = block_row_bits(block, row);
+	for(uint8_t col = BOARD_WIDTH - 1; bits; col--) {
+		if((bits & 1) && col < num_cells) {
+			cells[col] = colour;
+		}
+		bits >>= 1;
+	}
+}
+
+/*
+ * Get or set the given column's position in a row of a game snapshot. 
+ * Each position takes SNAPSHOT_CELL_BITS bits, starting from the least
+ * significant bit of the first byte, and may straddle two bytes.
+ */
+static uint8_t get_snapshot_cell(const uint8_t* cells, uint8_t col) {
+	uint16_t bit = col * SNAPSHOT_CELL_BITS;
+	uint16_t window = cells[bit / 8];
+	if(bit / 8 + 1 < SNAPSHOT_ROW_BYTES) {
+		window |= cells[bit / 8 + 1] << 8;
+	}
+	return (window >> (bit % 8)) & ((1 << SNAPSHOT_CELL_BITS) - 1);
+}
+
+static void set_snapshot_cell(uint8_t* cells, uint8_t col, uint8_t cell) {
+	uint16_t bit = col * SNAPSHOT_CELL_BITS;
+	uint16_t window = (uint16_t)cell << (bit % 8);
+	cells[bit / 8] |= window;
+	if(bit / 8 + 1 < SNAPSHOT_ROW_BYTES) {
+		cells[bit / 8 + 1] |= window >> 8;
+	}
+}
+
+/*
+ * Play the given sound effect (see timer2.h) if the game is visible.
+ */
+static void play_game_sound(const GameState* game, uint8_t effect) {
+	if(game->visible) {
+		play_sound_effect(effect);
+	}
+}
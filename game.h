@@ -6,33 +6,138 @@
  * Function prototypes for those functions available externally
  */
 
+#ifndef GAME_H_
+#define GAME_H_
+
 #include <stdint.h>
+#include "blocks.h"
+#include "ledmatrix.h"
 
 /*
- * The game board is 16 rows in size. Row 0 is considered to be at the top, 
- * row 15 is at the bottom. Each row is 8 columns wide.
+ * The size of the game board (BOARD_ROWS and BOARD_WIDTH) is given in 
+ * board.h.
+ *
+ * The LED matrix shows the bottom DISPLAY_ROWS rows of the board (all of
+ * them unless the board has more rows than the matrix has columns), one
+ * row per matrix column, and the left hand DISPLAY_WIDTH columns.
  */
-#define BOARD_ROWS 16
-#define BOARD_WIDTH 8
+#define DISPLAY_ROWS (BOARD_ROWS < MATRIX_NUM_COLUMNS ? \
+		BOARD_ROWS : MATRIX_NUM_COLUMNS)
+#define DISPLAY_FIRST_ROW (BOARD_ROWS - DISPLAY_ROWS)
+#define DISPLAY_WIDTH (BOARD_WIDTH < MATRIX_NUM_ROWS ? \
+		BOARD_WIDTH : MATRIX_NUM_ROWS)
+
+/* The colour of each position in a row of the board */
+typedef PixelColour BoardDisplayRow[BOARD_WIDTH];
 
 #define MOVE_LEFT 0
 #define MOVE_RIGHT 1
 
 /*
- * Initialise the game.
+ * Function to be called whenever a block is about to be fixed to the 
+ * board. It is given the block and whether it could have dropped 
+ * straight down to its position from the top of the board. 
  */
-void init_game(void); 
+typedef void (*LockHandler)(const FallingBlock* block, 
+		uint8_t dropped_straight);
 
-void set_cleared_count(uint8_t value);
+/*
+ * Number of upcoming blocks which are chosen ahead of time (and shown on
+ * the terminal).
+ */
+#define NUM_NEXT_BLOCKS 3
+
+/*
+ * Everything about a game in progress. The functions below all work on
+ * the game they are given, so any number of games can be played at once
+ * (e.g. on the host, or to try out moves). A GameState holds no pointers
+ * into itself, so a game can be copied or restored with a plain 
+ * assignment (or memcpy()).
+ *
+ * We keep two representations of the board:
+ *	- an array of "rowtype" rows (which has one bit per column
+ *    which indicates whether the given position is occupied or not). This 
+ *    representation does NOT include the current dropping block.
+ *  - an array of corresponding rows of colours (a row of the game
+ *    will be displayed on an LED matrix column). This records colour information
+ *    for each position. This also does NOT include the current dropping 
+ *    block - it is drawn over the board display as rows are sent to the
+ *    LED matrix by flush_display().
+ * For both representations, the array is indexed from row 0.
+ * For "board" - column 0 (bit 0) is on the right
+ * For "board_display" - element 0 within each row is on the left
+ *
+ * The upcoming blocks are kept (by block number) in a ring buffer - the
+ * next block is next_blocks[next_block_index], followed by the ones after
+ * it (wrapping around). As each block is taken, the generator chooses
+ * the block to go in its place at the end of the queue.
+ *
+ * visible and lock_handler are set by the caller and left alone by
+ * init_game(). Only a visible game plays sound effects, clears the LED
+ * matrix and shows its upcoming blocks on the terminal.
+ */
+typedef struct {
+	rowtype board[BOARD_ROWS];
+	BoardDisplayRow board_display[BOARD_ROWS];
+	FallingBlock current_block;	// Current dropping block - there will
+								// always be one if the game is being played
+	uint8_t next_blocks[NUM_NEXT_BLOCKS];	// Upcoming block numbers
+	uint8_t next_block_index;	// Position of the next block in next_blocks
+	uint32_t score;				// In packed BCD (see score.h)
+	uint32_t random_state;		// Block generator state (see blocks.h)
+	uint16_t rows_to_update;	// Rows of the LED display which have changed
+								// since it was last updated - bit n is set
+								// if board row DISPLAY_FIRST_ROW+n has
+								// changed
+	uint8_t cleared_count;		// In packed BCD
+	uint8_t game_over;			// Set when a new block couldn't be added
+	uint8_t visible;
+	LockHandler lock_handler;	// Called when a block is fixed (if set)
+} GameState;
+
+/*
+ * Initialise the game, with blocks chosen by a generator started from
+ * the given seed (the same seed always gives the same blocks).
+ */
+void init_game(GameState* game, uint32_t seed); 
+
+void set_cleared_count(GameState* game, uint8_t value);
+
+/*
+ * Return the number of rows cleared so far (up to 99), in binary or 
+ * packed BCD (see score.h). set_cleared_count() takes a binary count.
+ */
+uint8_t get_cleared_count(const GameState* game);
+uint8_t get_cleared_count_bcd(const GameState* game);
+
+/*
+ * Return the speed level (0 to NUM_SPEED_LEVELS-1), which goes up by one
+ * for each row cleared until the fastest drop interval is reached.
+ */
+#define NUM_SPEED_LEVELS 12
+uint8_t get_speed_level(const GameState* game);
+
+/*
+ * Return the number of the nth upcoming block (0 for the next block, up
+ * to NUM_NEXT_BLOCKS-1).
+ */
+uint8_t get_next_block(const GameState* game, uint8_t n);
 //void preview_block(preview_block uint8_t);
 /* 
- * Update the display for rows starting from the given row
+ * Mark the display as needing an update for rows starting from the given row
  * (row_start) and doing so for num_rows rows. row_start should be between
  * 0 and BOARD_ROWS-1 inclusive. num_rows beyond this must still be on the 
  * board.
  */
-void update_rows_on_display(uint8_t row_start, uint8_t num_rows);
-void reset_current_speed(void); 
+void update_rows_on_display(GameState* game, rownum row_start, 
+		rownum num_rows);
+
+/*
+ * Send the rows marked by update_rows_on_display() to the LED matrix,
+ * with the falling block drawn over the fixed blocks. Moving the falling
+ * block marks just the rows it changes.
+ */
+void flush_display(GameState* game);
 
 /*
  * attempt_move
@@ -42,34 +147,96 @@ void reset_current_speed(void);
  * the board prevented the move). Returns 1 on success. 
  * Should only be called if we have a current block.
  */
-uint8_t attempt_move(int8_t direction);
+uint8_t attempt_move(GameState* game, int8_t direction);
 
 /*
  * Attempt to drop the current block by one row. Returns 0 on failure,
  * 1 on success.
  */
-uint8_t attempt_drop_block_one_row(void);
+uint8_t attempt_drop_block_one_row(GameState* game);
 
 /*
  * Attempt rotation (clockwise) of the current block on the board. 
  * Returns 0 on failure, 1 on success. 
  */
-uint8_t attempt_rotation(void);
+uint8_t attempt_rotation(GameState* game);
 
 /*
  * Fix the current block to the board in its current position
  * and add another random block to the top. Returns 0 on failure
  * (new block could not be added - game over) or 1 on success.
  */
-uint8_t fix_block_to_board_and_add_new_block(void);
+uint8_t fix_block_to_board_and_add_new_block(GameState* game);
+
+/*
+ * Move the current block straight to the given rotation (0 to 3), column
+ * and row - or, if row is negative, as far down as it will drop from the
+ * top of the board - and fix it to the board. Returns 0 if the block
+ * can't be placed there or the game is over, 1 otherwise.
+ */
+uint8_t place_block(GameState* game, uint8_t rotation, uint8_t column, 
+		int16_t row);
+
+/*
+ * Set the function to be called when a block is fixed to the board (or
+ * 0 for none).
+ */
+void set_lock_handler(GameState* game, LockHandler handler);
+
+/*
+ * Compact copy of the state of a game (see snapshot.h), taken between
+ * blocks - i.e. just after a new block has been added to the top of the
+ * board. Each board position takes SNAPSHOT_CELL_BITS bits of its row -
+ * 0 if it is empty, otherwise 1 + the number of the block which filled
+ * it (which gives its colour). The current block and upcoming blocks 
+ * are kept two to a byte, current block first, in the low four bits 
+ * then the high four bits.
+ */
+#define SNAPSHOT_CELL_BITS 3
+#define SNAPSHOT_ROW_BYTES ((BOARD_WIDTH * SNAPSHOT_CELL_BITS + 7) / 8)
+#define SNAPSHOT_BLOCK_BYTES ((NUM_NEXT_BLOCKS + 2) / 2)
+typedef struct {
+	uint32_t score;
+	uint32_t random_state;	// Block generator state
+	uint8_t cells[BOARD_ROWS][SNAPSHOT_ROW_BYTES];
+	uint8_t blocks[SNAPSHOT_BLOCK_BYTES];	// Current and upcoming blocks
+	uint8_t cleared_count;
+} GameSnapshot;
+
+/*
+ * Take a snapshot of the game. Should only be called between blocks
+ * (e.g. straight after a block has been fixed to the board).
+ */
+void save_game_snapshot(const GameState* game, GameSnapshot* snapshot);
+
+/*
+ * Carry on the game from the given snapshot instead of starting a new
+ * one (call instead of init_game()). Returns 1 on success, 0 if the 
+ * snapshot isn't valid - init_game() should then be called.
+ */
+uint8_t restore_game_snapshot(GameState* game, 
+		const GameSnapshot* snapshot);
 
-void update_seven_seg();
+/*
+ * Apply the given game action (INPUT_MOVE_LEFT etc. - see input.h) to
+ * the current block. A soft or gravity drop that can't be made fixes
+ * the block to the board and adds a new one. Returns 0 if the game is 
+ * over, 1 otherwise. Live play and replays both go through here.
+ */
+uint8_t apply_game_action(GameState* game, uint8_t action);
 
 int get_is_running(void);
 
+/*
+ * Note that a game is running.
+ */
 void set_is_running(void); 
 
-float get_acceleration(void);
-
-void accelerate(void);
+/*
+ * Return the time (in ms) between gravity drops for the number of rows
+ * cleared so far. The interval shrinks as rows are cleared, down to a
+ * minimum.
+ */
+uint16_t get_drop_interval(const GameState* game);
 
+#endif /* GAME_H_ */
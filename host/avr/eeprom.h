@@ -0,0 +1,23 @@
+/*
+ * host/avr/eeprom.h
+ *
+ * Stand-in for <avr/eeprom.h> when building the game engine on the 
+ * host. The EEPROM is simulated in RAM by host_stubs.c.
+ */
+
+#ifndef HOST_AVR_EEPROM_H_
+#define HOST_AVR_EEPROM_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+uint8_t eeprom_read_byte(const uint8_t* address);
+uint16_t eeprom_read_word(const uint16_t* address);
+void eeprom_read_block(void* destination, const void* source, size_t n);
+void eeprom_write_byte(uint8_t* address, uint8_t value);
+void eeprom_write_word(uint16_t* address, uint16_t value);
+void eeprom_update_byte(uint8_t* address, uint8_t value);
+void eeprom_update_word(uint16_t* address, uint16_t value);
+void eeprom_update_block(const void* source, void* destination, size_t n);
+
+#endif /* HOST_AVR_EEPROM_H_ */
@@ -0,0 +1,21 @@
+/*
+ * host/avr/io.h
+ *
+ * Stand-in for <avr/io.h> when building the game engine on the host.
+ * Only the registers the engine modules touch are provided - writes to
+ * them go to ordinary variables defined in host_stubs.c.
+ */
+
+#ifndef HOST_AVR_IO_H_
+#define HOST_AVR_IO_H_
+
+#include <stdint.h>
+
+extern volatile uint8_t PORTA;
+extern volatile uint8_t PORTC;
+extern volatile uint8_t PIND;
+
+#define PINA7 7
+#define PIND6 6
+
+#endif /* HOST_AVR_IO_H_ */
@@ -0,0 +1,25 @@
+/*
+ * host/avr/pgmspace.h
+ *
+ * Stand-in for <avr/pgmspace.h> when building the game engine on the
+ * host. Program memory is ordinary memory, and terminal output from the
+ * engine goes through host_printf_P() (see host_stubs.c) so that it can
+ * be switched off.
+ */
+
+#ifndef HOST_AVR_PGMSPACE_H_
+#define HOST_AVR_PGMSPACE_H_
+
+#include <stdint.h>
+#include <string.h>
+
+#define PROGMEM
+#define PSTR(s) (s)
+#define pgm_read_byte(address) (*(const uint8_t*)(address))
+#define pgm_read_word(address) (*(const uint16_t*)(address))
+#define memcpy_P memcpy
+
+int host_printf_P(const char* format, ...);
+#define printf_P host_printf_P
+
+#endif /* HOST_AVR_PGMSPACE_H_ */
@@ -0,0 +1,446 @@
+/*
+ * batch.c
+ *
+ * Author: Elliot Randall
+ *
+ * Plays a large batch of seeded games through a host build of the game
+ * engine, on all cores, to measure how fast the engine runs and how hard
+ * the game is. Each game is played by a policy - "random" drops each
+ * block at a random rotation and column, "heuristic" uses the computer
+ * player from autoplay.h - with each block placed straight where the
+ * policy chooses (see place_block()). Build from the top of the
+ * repository with:
+ *
+ *     gcc -std=gnu11 -O2 -pthread -Ihost -I. -o batch host/batch.c \
+ *         host/host_stubs.c game.c blocks.c score.c ledmatrix.c \
+ *         terminalio.c autoplay.c
+ *
+ * and run as "./batch [-n games] [-s first_seed] [-p random|heuristic]
+ * [-m max_pieces] [-j threads]". Game n of the batch uses seed
+ * first_seed + n, so any game can be played again on its own.
+ *
+ * The seeds are shared out between the threads in ranges. Each thread
+ * takes chunks of games from the front of its own range, and when that
+ * runs out, steals the back half of the largest range left. Each thread
+ * keeps its own totals, which are added together once all the threads
+ * have finished.
+ *
+ * Game time is worked out as if each block fell under gravity alone from
+ * the top of the board to where it was placed, at the drop interval (see
+ * get_drop_interval()) in force when it appeared. This gives how long a
+ * game would last against the speed curve, rather than how long it took
+ * the policy to play.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "host_stubs.h"
+#include "game.h"
+#include "score.h"
+#include "blocks.h"
+#include "autoplay.h"
+
+#define DEFAULT_GAMES 10000
+#define DEFAULT_MAX_PIECES 10000
+#define MAX_THREADS 256
+
+// Games taken by a thread at a time
+#define CHUNK_SIZE 16
+
+// Most rows that can be cleared by one block - the tallest block's height
+#define MAX_ROWS_AT_ONCE 4
+
+// Games are counted by rows cleared in buckets of powers of 10 - 0, 1-9,
+// 10-99 and so on
+#define NUM_ROW_BUCKETS 6
+
+#define CACHE_LINE_SIZE 64
+
+typedef enum {
+	POLICY_RANDOM,
+	POLICY_HEURISTIC
+} Policy;
+
+/* Totals for the games played by one thread */
+typedef struct {
+	uint64_t games;
+	uint64_t pieces;
+	uint64_t rows;
+	uint64_t game_time;		// Total game time (ms)
+	uint64_t capped;		// Games stopped at the maximum number of pieces
+	uint64_t chunks;		// Chunks of games taken
+	uint64_t steals;		// Ranges stolen from other threads
+	// Blocks placed by the number of rows they cleared
+	uint64_t clears[MAX_ROWS_AT_ONCE + 1];
+	// Games by rows cleared, in buckets (see NUM_ROW_BUCKETS)
+	uint64_t row_buckets[NUM_ROW_BUCKETS];
+	// For each speed level - games which reached it, the total game time
+	// at which they did, and the blocks placed and game time spent at it
+	uint64_t level_games[NUM_SPEED_LEVELS];
+	uint64_t level_reached_time[NUM_SPEED_LEVELS];
+	uint64_t level_pieces[NUM_SPEED_LEVELS];
+	uint64_t level_time[NUM_SPEED_LEVELS];
+} Totals;
+
+/*
+ * A thread, with the range of games it has left to play. The range is
+ * kept as the index of its next game (top 32 bits) and the index after
+ * its last (bottom 32 bits) in one word, so that the owner taking games
+ * from the front and a thief taking them from the back can't both have
+ * the same game. Each thread is on its own cache lines, so a thread
+ * updating its totals doesn't slow the others down.
+ */
+typedef struct {
+	_Alignas(CACHE_LINE_SIZE) _Atomic uint64_t range;
+	pthread_t thread;
+	GameState game;
+	Totals totals;
+} Worker;
+
+#define RANGE(first, end) (((uint64_t)(first) << 32) | (uint32_t)(end))
+#define RANGE_FIRST(range) ((uint32_t)((range) >> 32))
+#define RANGE_END(range) ((uint32_t)(range))
+
+static Worker workers[MAX_THREADS];
+static unsigned num_threads;
+
+// Options
+static unsigned long num_games = DEFAULT_GAMES;
+static uint32_t first_seed = 1;
+static unsigned long max_pieces = DEFAULT_MAX_PIECES;
+static Policy policy = POLICY_HEURISTIC;
+
+// Row at which the last block was fixed, set by the lock handler. Each
+// thread has its own.
+static __thread rownum fixed_row;
+
+static void block_locked(const FallingBlock* block,
+		uint8_t dropped_straight) {
+	(void)dropped_straight;
+	fixed_row = block->row;
+}
+
+/*
+ * Take the next chunk of games from the front of the worker's range.
+ * Returns 0 if the range is empty.
+ */
+static int take_chunk(Worker* worker, uint32_t* first, uint32_t* end) {
+	uint64_t range = atomic_load(&worker->range);
+	for(;;) {
+		uint32_t next = RANGE_FIRST(range);
+		uint32_t last = RANGE_END(range);
+		if(next >= last) {
+			return 0;
+		}
+		uint32_t chunk_end = (last - next > CHUNK_SIZE) ?
+				next + CHUNK_SIZE : last;
+		if(atomic_compare_exchange_weak(&worker->range, &range,
+				RANGE(chunk_end, last))) {
+			*first = next;
+			*end = chunk_end;
+			return 1;
+		}
+	}
+}
+
+/*
+ * Steal the back half of the largest range left and make it the thief's
+ * own. Returns 0 if there's nothing left to steal.
+ */
+static int steal_range(Worker* thief) {
+	for(;;) {
+		Worker* victim = 0;
+		uint64_t victim_range = 0;
+		uint32_t most = 0;
+		for(unsigned i = 0; i < num_threads; i++) {
+			uint64_t range = atomic_load(&workers[i].range);
+			uint32_t left = RANGE_END(range) - RANGE_FIRST(range);
+			if(&workers[i] != thief && RANGE_FIRST(range) <
+					RANGE_END(range) && left > most) {
+				victim = &workers[i];
+				victim_range = range;
+				most = left;
+			}
+		}
+		if(!victim) {
+			return 0;
+		}
+
+		// Leave the victim at least the chunk it could be about to take
+		uint32_t next = RANGE_FIRST(victim_range);
+		uint32_t last = RANGE_END(victim_range);
+		uint32_t split = (most > CHUNK_SIZE) ? last - most / 2 : next;
+		if(atomic_compare_exchange_strong(&victim->range, &victim_range,
+				RANGE(next, split))) {
+			// Nobody else changes an empty range, so this can't be lost
+			atomic_store(&thief->range, RANGE(split, last));
+			thief->totals.steals++;
+			return 1;
+		}
+		// The victim's range changed under us - look again
+	}
+}
+
+/*
+ * Place the current block at a random rotation and column it can go.
+ * Returns 0 if it can't go anywhere.
+ */
+static uint8_t place_randomly(GameState* game, uint32_t* random_state) {
+	// xorshift32, as the block generator's sequence must be left alone
+	uint32_t x = *random_state;
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	*random_state = x;
+
+	uint8_t num_choices = NUM_ROTATIONS * BOARD_WIDTH;
+	uint8_t start = x % num_choices;
+	for(uint8_t i = 0; i < num_choices; i++) {
+		uint8_t choice = (start + i) % num_choices;
+		if(place_block(game, choice / BOARD_WIDTH, choice % BOARD_WIDTH,
+				-1) || game->game_over) {
+			return 1;
+		}
+	}
+	return 0;
+}
+
+static void play_game(Worker* worker, uint32_t seed) {
+	GameState* game = &worker->game;
+	Totals* totals = &worker->totals;
+	uint32_t random_state = seed ? seed : 1;
+	uint64_t game_time = 0;
+	unsigned long pieces = 0;
+	uint8_t level_reached = 0;
+
+	host_new_game(game, seed);
+	set_lock_handler(game, block_locked);
+	totals->level_games[0]++;
+
+	while(!game->game_over) {
+		if(pieces == max_pieces) {
+			totals->capped++;
+			break;
+		}
+		uint8_t level = get_speed_level(game);
+		uint16_t drop_interval = get_drop_interval(game);
+		uint32_t score = get_score(game);
+
+		uint8_t placed;
+		if(policy == POLICY_RANDOM) {
+			placed = place_randomly(game, &random_state);
+		} else {
+			AutoplayMove move;
+			placed = autoplay_choose(game, &move) &&
+					(place_block(game, move.rotation, move.column, -1) ||
+					game->game_over);
+		}
+		if(!placed) {
+			break;
+		}
+
+		// Each block scores 1, plus 100 for each row it clears
+		uint32_t rows = (get_score(game) - score) / 100;
+		if(rows > MAX_ROWS_AT_ONCE) {
+			rows = MAX_ROWS_AT_ONCE;
+		}
+		uint32_t fall_time = (uint32_t)(fixed_row + 1) * drop_interval;
+		pieces++;
+		game_time += fall_time;
+		totals->clears[rows]++;
+		totals->rows += rows;
+		totals->level_pieces[level]++;
+		totals->level_time[level] += fall_time;
+
+		while(level_reached < get_speed_level(game)) {
+			level_reached++;
+			totals->level_games[level_reached]++;
+			totals->level_reached_time[level_reached] += game_time;
+		}
+	}
+
+	uint32_t rows = (get_score(game) - pieces) / 100;
+	uint8_t bucket = 0;
+	for(uint32_t limit = 1; rows >= limit && bucket < NUM_ROW_BUCKETS - 1;
+			limit *= 10) {
+		bucket++;
+	}
+	totals->row_buckets[bucket]++;
+	totals->games++;
+	totals->pieces += pieces;
+	totals->game_time += game_time;
+}
+
+static void* run_worker(void* argument) {
+	Worker* worker = argument;
+	uint32_t first, end;
+
+	do {
+		while(take_chunk(worker, &first, &end)) {
+			worker->totals.chunks++;
+			for(uint32_t i = first; i < end; i++) {
+				play_game(worker, first_seed + i);
+			}
+		}
+	} while(steal_range(worker));
+	return 0;
+}
+
+static void add_totals(Totals* to, const Totals* from) {
+	to->games += from->games;
+	to->pieces += from->pieces;
+	to->rows += from->rows;
+	to->game_time += from->game_time;
+	to->capped += from->capped;
+	to->chunks += from->chunks;
+	to->steals += from->steals;
+	for(int i = 0; i <= MAX_ROWS_AT_ONCE; i++) {
+		to->clears[i] += from->clears[i];
+	}
+	for(int i = 0; i < NUM_ROW_BUCKETS; i++) {
+		to->row_buckets[i] += from->row_buckets[i];
+	}
+	for(int i = 0; i < NUM_SPEED_LEVELS; i++) {
+		to->level_games[i] += from->level_games[i];
+		to->level_reached_time[i] += from->level_reached_time[i];
+		to->level_pieces[i] += from->level_pieces[i];
+		to->level_time[i] += from->level_time[i];
+	}
+}
+
+static double now(void) {
+	struct timespec time;
+	clock_gettime(CLOCK_MONOTONIC, &time);
+	return time.tv_sec + time.tv_nsec / 1e9;
+}
+
+static double per(uint64_t count, uint64_t total) {
+	return total ? (double)count / total : 0.0;
+}
+
+static void usage(const char* name) {
+	fprintf(stderr, "usage: %s [-n games] [-s first_seed] "
+			"[-p random|heuristic] [-m max_pieces] [-j threads]\n", name);
+	exit(2);
+}
+
+int main(int argc, char* argv[]) {
+	int option;
+	long threads = sysconf(_SC_NPROCESSORS_ONLN);
+
+	while((option = getopt(argc, argv, "n:s:p:m:j:")) != -1) {
+		switch(option) {
+			case 'n':
+				num_games = strtoul(optarg, 0, 0);
+				break;
+			case 's':
+				first_seed = strtoul(optarg, 0, 0);
+				break;
+			case 'p':
+				if(strcmp(optarg, "random") == 0) {
+					policy = POLICY_RANDOM;
+				} else if(strcmp(optarg, "heuristic") == 0) {
+					policy = POLICY_HEURISTIC;
+				} else {
+					usage(argv[0]);
+				}
+				break;
+			case 'm':
+				max_pieces = strtoul(optarg, 0, 0);
+				break;
+			case 'j':
+				threads = strtol(optarg, 0, 0);
+				break;
+			default:
+				usage(argv[0]);
+		}
+	}
+	if(num_games == 0 || num_games > UINT32_MAX || threads < 1) {
+		usage(argv[0]);
+	}
+	num_threads = threads > MAX_THREADS ? MAX_THREADS : threads;
+
+	// Share the games out evenly to start with
+	for(unsigned i = 0; i < num_threads; i++) {
+		atomic_init(&workers[i].range,
+				RANGE(num_games * i / num_threads,
+				num_games * (i + 1) / num_threads));
+	}
+
+	double start = now();
+	for(unsigned i = 0; i < num_threads; i++) {
+		if(pthread_create(&workers[i].thread, 0, run_worker, &workers[i])) {
+			perror("pthread_create");
+			return 1;
+		}
+	}
+	Totals totals;
+	memset(&totals, 0, sizeof(totals));
+	for(unsigned i = 0; i < num_threads; i++) {
+		pthread_join(workers[i].thread, 0);
+		add_totals(&totals, &workers[i].totals);
+	}
+	double elapsed = now() - start;
+
+	printf("%llu games (seeds %lu to %lu), %s policy, %u threads, "
+			"%.2fs\n", (unsigned long long)totals.games,
+			(unsigned long)first_seed,
+			(unsigned long)(first_seed + num_games - 1),
+			policy == POLICY_RANDOM ? "random" : "heuristic",
+			num_threads, elapsed);
+	printf("%.0f games/s, %.0f pieces/s\n", totals.games / elapsed,
+			totals.pieces / elapsed);
+	printf("%llu chunks taken, %llu ranges stolen\n",
+			(unsigned long long)totals.chunks,
+			(unsigned long long)totals.steals);
+	printf("per game: %.1f pieces, %.2f rows, %.1fs game time; "
+			"%llu stopped at %lu pieces\n",
+			per(totals.pieces, totals.games), per(totals.rows, totals.games),
+			per(totals.game_time, totals.games) / 1000,
+			(unsigned long long)totals.capped, max_pieces);
+
+	printf("\nrows cleared at once   blocks\n");
+	for(int i = 0; i <= MAX_ROWS_AT_ONCE; i++) {
+		printf("%20d   %6.2f%%\n", i,
+				100 * per(totals.clears[i], totals.pieces));
+	}
+
+	printf("\nrows cleared per game   games\n");
+	for(int i = 0, limit = 1; i < NUM_ROW_BUCKETS; i++, limit *= 10) {
+		char label[24];
+		if(i == 0) {
+			snprintf(label, sizeof(label), "0");
+		} else if(i == NUM_ROW_BUCKETS - 1) {
+			snprintf(label, sizeof(label), "%d+", limit / 10);
+		} else {
+			snprintf(label, sizeof(label), "%d-%d", limit / 10, limit - 1);
+		}
+		printf("%21s   %6.2f%%\n", label,
+				100 * per(totals.row_buckets[i], totals.games));
+	}
+
+	// Survival against the speed curve. The drop interval for each level
+	// comes from a game with that many rows cleared.
+	GameState game;
+	printf("\nlevel  interval  reached  at time  pieces/game  time/game\n");
+	for(int level = 0; level < NUM_SPEED_LEVELS; level++) {
+		host_new_game(&game, 0);
+		set_cleared_count(&game, level);
+		printf("%5d  %6ums  %6.2f%%  %6.1fs  %11.1f  %8.1fs\n", level,
+				get_drop_interval(&game),
+				100 * per(totals.level_games[level], totals.games),
+				per(totals.level_reached_time[level],
+				totals.level_games[level]) / 1000,
+				per(totals.level_pieces[level], totals.level_games[level]),
+				per(totals.level_time[level],
+				totals.level_games[level]) / 1000);
+	}
+	return 0;
+}
@@ -0,0 +1,121 @@
+/*
+ * host_stubs.c
+ *
+ * Author: Elliot Randall
+ *
+ * Hardware stand-ins that allow the game engine (game.c, blocks.c, 
+ * score.c, ledmatrix.c and terminalio.c) to be built and run on the 
+ * host. The SPI link to the LED matrix discards everything sent to it,
+ * the EEPROM is simulated in RAM and terminal output is discarded 
+ * unless host_verbose is set.
+ */
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <avr/io.h>
+#include <avr/eeprom.h>
+
+#include "host_stubs.h"
+#include "serialio.h"
+#include "spi.h"
+#include "game.h"
+#include "score.h"
+#include "blocks.h"
+#include "timer2.h"
+
+volatile uint8_t PORTA;
+volatile uint8_t PORTC;
+volatile uint8_t PIND;
+
+int host_verbose = 0;
+
+// The ATmega324A has 1K of EEPROM, which is all ones when erased
+#define EEPROM_SIZE 1024
+static uint8_t eeprom[EEPROM_SIZE];
+static int eeprom_initialised = 0;
+
+int host_printf_P(const char* format, ...) {
+	int result = 0;
+	if(host_verbose) {
+		va_list args;
+		va_start(args, format);
+		result = vprintf(format, args);
+		va_end(args);
+	}
+	return result;
+}
+
+void serial_write_P(const char* string) {
+	if(host_verbose) {
+		fputs(string, stdout);
+	}
+}
+
+void spi_setup_master(uint8_t clockdivider) {
+	(void)clockdivider;
+}
+
+uint8_t spi_send_byte(uint8_t byte) {
+	return byte;
+}
+
+static uint8_t* eeprom_location(const void* address) {
+	if(!eeprom_initialised) {
+		memset(eeprom, 0xFF, EEPROM_SIZE);
+		eeprom_initialised = 1;
+	}
+	return &eeprom[(uintptr_t)address % EEPROM_SIZE];
+}
+
+uint8_t eeprom_read_byte(const uint8_t* address) {
+	return *eeprom_location(address);
+}
+
+uint16_t eeprom_read_word(const uint16_t* address) {
+	return eeprom_read_byte((const uint8_t*)address) | 
+			(eeprom_read_byte((const uint8_t*)address + 1) << 8);
+}
+
+void eeprom_read_block(void* destination, const void* source, size_t n) {
+	for(size_t i = 0; i < n; i++) {
+		((uint8_t*)destination)[i] = 
+				eeprom_read_byte((const uint8_t*)source + i);
+	}
+}
+
+void eeprom_write_byte(uint8_t* address, uint8_t value) {
+	*eeprom_location(address) = value;
+}
+
+void eeprom_write_word(uint16_t* address, uint16_t value) {
+	eeprom_write_byte((uint8_t*)address, value & 0xFF);
+	eeprom_write_byte((uint8_t*)address + 1, value >> 8);
+}
+
+void eeprom_update_byte(uint8_t* address, uint8_t value) {
+	eeprom_write_byte(address, value);
+}
+
+void eeprom_update_word(uint16_t* address, uint16_t value) {
+	eeprom_write_word(address, value);
+}
+
+void eeprom_update_block(const void* source, void* destination, size_t n) {
+	for(size_t i = 0; i < n; i++) {
+		eeprom_write_byte((uint8_t*)destination + i, 
+				((const uint8_t*)source)[i]);
+	}
+}
+
+void play_sound_effect(uint8_t effect) {
+	(void)effect;
+}
+
+void host_new_game(GameState* game, uint32_t seed) {
+	// Only show the game if we're showing terminal output
+	game->visible = host_verbose;
+	game->lock_handler = 0;
+	init_game(game, seed);
+}
@@ -0,0 +1,25 @@
+/*
+ * host_stubs.h
+ *
+ * Hardware stand-ins for host builds of the game engine. See 
+ * host_stubs.c.
+ */
+
+#ifndef HOST_STUBS_H_
+#define HOST_STUBS_H_
+
+#include <stdint.h>
+#include "game.h"
+
+/* If non-zero, terminal output from the engine (printf_P) is written to
+ * standard output. Otherwise it is discarded. Defaults to 0.
+ */
+extern int host_verbose;
+
+/* Start a new game in the same way as new_game() in project.c, using
+ * the given block generator seed. The game is only visible (see game.h)
+ * if host_verbose is set, and has no lock handler.
+ */
+void host_new_game(GameState* game, uint32_t seed);
+
+#endif /* HOST_STUBS_H_ */
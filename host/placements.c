@@ -0,0 +1,146 @@
+/*
+ * placements.c
+ *
+ * Author: Elliot Randall
+ *
+ * Rebuilds games from a placement log dumped by the device (see 
+ * placement_log.h) through a host build of the game engine, and checks
+ * that each reaches the logged score. Reads the captured serial output
+ * on standard input - the logs are picked out of the normal terminal
+ * output. Build from the top of the repository with:
+ *
+ *     gcc -std=gnu99 -O2 -Ihost -I. -o placements host/placements.c \
+ *         host/host_stubs.c game.c blocks.c score.c ledmatrix.c terminalio.c
+ *
+ * and run as "./placements [-v] < capture.txt". With -v, the engine's 
+ * terminal output is shown. Exits with status 1 if any game didn't 
+ * match its log.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "host_stubs.h"
+#include "game.h"
+#include "score.h"
+#include "placement_log.h"
+
+#define ESCAPE_CHAR 27
+
+// The game being rebuilt
+static GameState game;
+
+static int games = 0;
+static int mismatches = 0;
+
+static int hex_digit(char c) {
+	if(c >= '0' && c <= '9') {
+		return c - '0';
+	}
+	if(c >= 'a' && c <= 'f') {
+		return c - 'a' + 10;
+	}
+	if(c >= 'A' && c <= 'F') {
+		return c - 'A' + 10;
+	}
+	return -1;
+}
+
+/* Return the next byte of placements (two hex digits) or -1 at the end 
+ * of the log.
+ */
+static int next_byte(const char** hex) {
+	int high = hex_digit((*hex)[0]);
+	if(high < 0) {
+		return -1;
+	}
+	int low = hex_digit((*hex)[1]);
+	if(low < 0) {
+		return -1;
+	}
+	*hex += 2;
+	return (high << 4) | low;
+}
+
+/*
+ * Rebuild the game in one log (the text between ESC _ L and ESC \).
+ */
+static void handle_log(const char* log) {
+	unsigned int sequence;
+	unsigned long seed, score;
+	int offset;
+	
+	if(sscanf(log, "%u,%lx,%lu,%n", &sequence, &seed, &score, &offset) != 3) {
+		return;
+	}
+	const char* hex = log + offset;
+	
+	host_new_game(&game, seed);
+	unsigned long pieces = 0, tucks = 0;
+	int game_over = 0;
+	int bad_placement = 0;
+	int byte;
+	while(!game_over && (byte = next_byte(&hex)) >= 0) {
+		int row = -1;
+		if(PLACEMENT_BLOCKNUM(byte) == PLACEMENT_ROW_FOLLOWS) {
+			row = next_byte(&hex);
+			if(row < 0) {
+				bad_placement = 1;
+				break;
+			}
+			tucks++;
+		}
+		pieces++;
+		if(!place_block(&game, PLACEMENT_ROTATION(byte), 
+				PLACEMENT_COLUMN(byte), row)) {
+			game_over = 1;
+		}
+	}
+	
+	games++;
+	int matched = game_over && !bad_placement && get_score(&game) == score;
+	if(!matched) {
+		mismatches++;
+	}
+	printf("game %u seed %08lx: %lu pieces (%lu not dropped straight), "
+			"%u rows, score %lu (logged %lu)%s%s\n",
+			sequence, seed, pieces, tucks, get_cleared_count(&game),
+			(unsigned long)get_score(&game), score,
+			game_over ? "" : ", game not over",
+			matched ? " - OK" : " - MISMATCH");
+}
+
+int main(int argc, char* argv[]) {
+	static char record[1024];
+	size_t length = 0;
+	int in_record = 0;
+	int last_char = 0;
+	int c;
+	
+	if(argc > 1 && strcmp(argv[1], "-v") == 0) {
+		host_verbose = 1;
+	}
+	
+	// Logs are APC strings - ESC _ L<log> ESC backslash
+	while((c = getchar()) != EOF) {
+		if(last_char == ESCAPE_CHAR && c == '_') {
+			in_record = 1;
+			length = 0;
+		} else if(in_record && last_char == ESCAPE_CHAR && c == '\\') {
+			record[length] = '\0';
+			if(record[0] == 'L') {
+				handle_log(record + 1);
+			}
+			in_record = 0;
+		} else if(in_record && c != ESCAPE_CHAR) {
+			if(length < sizeof(record) - 1) {
+				record[length++] = c;
+			}
+		}
+		last_char = c;
+	}
+	
+	printf("%d games rebuilt, %d mismatches\n", games, mismatches);
+	return mismatches ? 1 : 0;
+}
@@ -0,0 +1,128 @@
+/*
+ * replay.c
+ *
+ * Author: Elliot Randall
+ *
+ * Replays games recorded on the device (see record.h) through a host
+ * build of the game engine and checks that each replay reaches the
+ * recorded score. Reads the captured serial output on standard input - 
+ * recordings are picked out of the normal terminal output, so the whole
+ * capture can be passed in. Build from the top of the repository with:
+ *
+ *     gcc -std=gnu99 -O2 -Ihost -I. -o replay host/replay.c \
+ *         host/host_stubs.c game.c blocks.c score.c ledmatrix.c terminalio.c
+ *
+ * and run as "./replay [-v] < capture.txt". With -v, the engine's 
+ * terminal output is shown. Exits with status 1 if any replay didn't
+ * match its recording.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "host_stubs.h"
+#include "game.h"
+#include "score.h"
+#include "input.h"
+
+#define ESCAPE_CHAR 27
+
+// The game being replayed
+static GameState game;
+
+static int games = 0;
+static int mismatches = 0;
+
+/* State of the game currently being replayed */
+static int in_game = 0;			// Have we seen a start of game record
+static int game_over = 0;
+static unsigned long seed;
+static unsigned long num_actions;
+static unsigned long total_ticks;
+
+/*
+ * Handle one record (the text between ESC _ and ESC \).
+ */
+static void handle_record(const char* record) {
+	unsigned int action, ticks;
+	unsigned long score;
+	
+	switch(record[0]) {
+		case 'S':
+			seed = strtoul(record + 1, NULL, 16);
+			host_new_game(&game, seed);
+			in_game = 1;
+			game_over = 0;
+			num_actions = 0;
+			total_ticks = 0;
+			break;
+		case 'T':
+			printf("seed %08lx: recording lost its oldest actions - skipped\n",
+					strtoul(record + 1, NULL, 16));
+			in_game = 0;
+			break;
+		case 'R':
+			if(!in_game || sscanf(record + 1, "%u,%u", &action, &ticks) != 2) {
+				break;
+			}
+			num_actions++;
+			total_ticks += ticks;
+			if(game_over) {
+				break;	// Actions after the end of the game are ignored
+			}
+			if(!apply_game_action(&game, action)) {
+				game_over = 1;
+			}
+			break;
+		case 'E':
+			if(!in_game) {
+				break;
+			}
+			score = strtoul(record + 1, NULL, 10);
+			games++;
+			int matched = game_over && get_score(&game) == score;
+			if(!matched) {
+				mismatches++;
+			}
+			printf("seed %08lx: %lu actions over %.1fs, score %lu (recorded %lu)%s%s\n",
+					seed, num_actions, total_ticks / 1000.0, 
+					(unsigned long)get_score(&game), score,
+					game_over ? "" : ", game not over",
+					matched ? " - OK" : " - MISMATCH");
+			in_game = 0;
+			break;
+	}
+}
+
+int main(int argc, char* argv[]) {
+	char record[32];
+	size_t length = 0;
+	int in_record = 0;
+	int last_char = 0;
+	int c;
+	
+	if(argc > 1 && strcmp(argv[1], "-v") == 0) {
+		host_verbose = 1;
+	}
+	
+	// Records are APC strings - ESC _ <record> ESC backslash
+	while((c = getchar()) != EOF) {
+		if(last_char == ESCAPE_CHAR && c == '_') {
+			in_record = 1;
+			length = 0;
+		} else if(in_record && last_char == ESCAPE_CHAR && c == '\\') {
+			record[length] = '\0';
+			handle_record(record);
+			in_record = 0;
+		} else if(in_record && c != ESCAPE_CHAR) {
+			if(length < sizeof(record) - 1) {
+				record[length++] = c;
+			}
+		}
+		last_char = c;
+	}
+	
+	printf("%d games replayed, %d mismatches\n", games, mismatches);
+	return mismatches ? 1 : 0;
+}
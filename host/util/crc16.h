@@ -0,0 +1,26 @@
+/*
+ * host/util/crc16.h
+ *
+ * Stand-in for <util/crc16.h> when building the game engine on the 
+ * host. Gives the same results as the avr-libc functions.
+ */
+
+#ifndef HOST_UTIL_CRC16_H_
+#define HOST_UTIL_CRC16_H_
+
+#include <stdint.h>
+
+/* CRC-16 (polynomial 0xA001, reflected) */
+static inline uint16_t _crc16_update(uint16_t crc, uint8_t data) {
+	crc ^= data;
+	for(uint8_t i = 0; i < 8; i++) {
+		if(crc & 1) {
+			crc = (crc >> 1) ^ 0xA001;
+		} else {
+			crc = (crc >> 1);
+		}
+	}
+	return crc;
+}
+
+#endif /* HOST_UTIL_CRC16_H_ */
@@ -0,0 +1,128 @@
+/*
+ * input.c
+ *
+ * Author: Elliot Randall
+ *
+ * See input.h for details.
+ */
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+
+#include "input.h"
+#include "timer0.h"
+
+// ASCII code for Escape character
+#define ESCAPE_CHAR 27
+
+// Our event queue. This is a circular buffer - events are added at
+// queue_tail and removed from queue_head. Events may be added from more
+// than one interrupt handler (and the main program) so adding is done
+// with interrupts off. Only the main program removes events.
+#define INPUT_QUEUE_SIZE 16
+static volatile InputEvent input_queue[INPUT_QUEUE_SIZE];
+static volatile uint8_t queue_head;
+static volatile uint8_t queue_tail;
+static volatile uint16_t dropped_events;
+
+static volatile uint8_t enabled;
+
+// Number of characters we are into a serial escape sequence (0 to 2).
+// Only used from the serial receive interrupt handler.
+static uint8_t characters_into_escape_sequence;
+
+void input_set_enabled(uint8_t enable) {
+	uint8_t interrupts_were_on = bit_is_set(SREG, SREG_I);
+	cli();
+	queue_head = queue_tail;
+	characters_into_escape_sequence = 0;
+	enabled = enable;
+	if(interrupts_were_on) {
+		sei();
+	}
+}
+
+uint8_t input_enabled(void) {
+	return enabled;
+}
+
+void input_empty_queue(void) {
+	queue_head = queue_tail;
+}
+
+uint8_t input_get_event(InputEvent* event) {
+	if(queue_head == queue_tail) {
+		return 0;
+	}
+	*event = input_queue[queue_head];
+	queue_head = (queue_head + 1) % INPUT_QUEUE_SIZE;
+	return 1;
+}
+
+uint8_t input_post_event(uint8_t source, uint8_t action) {
+	uint8_t posted = 0;
+	uint32_t now = get_clock_ticks();
+	
+	uint8_t interrupts_were_on = bit_is_set(SREG, SREG_I);
+	cli();
+	uint8_t next_tail = (queue_tail + 1) % INPUT_QUEUE_SIZE;
+	if(next_tail == queue_head) {
+		if(dropped_events != UINT16_MAX) {
+			dropped_events++;
+		}
+	} else {
+		input_queue[queue_tail].source = source;
+		input_queue[queue_tail].action = action;
+		input_queue[queue_tail].time = now;
+		queue_tail = next_tail;
+		posted = 1;
+	}
+	if(interrupts_were_on) {
+		sei();
+	}
+	return posted;
+}
+
+void input_serial_char(char c) {
+	// Serial input may be part of an escape sequence, e.g. ESC [ D
+	// is a left cursor key press. We can't do anything with a cursor 
+	// key until we get the third character.
+	if(characters_into_escape_sequence == 0 && c == ESCAPE_CHAR) {
+		characters_into_escape_sequence++;
+		return;
+	} else if(characters_into_escape_sequence == 1 && c == '[') {
+		characters_into_escape_sequence++;
+		return;
+	} else if(characters_into_escape_sequence == 2) {
+		characters_into_escape_sequence = 0;
+		switch(c) {
+			case 'D': input_post_event(INPUT_SOURCE_SERIAL, INPUT_MOVE_LEFT); break;
+			case 'C': input_post_event(INPUT_SOURCE_SERIAL, INPUT_MOVE_RIGHT); break;
+			case 'A': input_post_event(INPUT_SOURCE_SERIAL, INPUT_ROTATE); break;
+			case 'B': input_post_event(INPUT_SOURCE_SERIAL, INPUT_SOFT_DROP); break;
+		}
+		return;
+	}
+	
+	// Character was not part of an escape sequence (or we received
+	// an invalid second character in the sequence)
+	characters_into_escape_sequence = 0;
+	switch(c) {
+		case ' ': input_post_event(INPUT_SOURCE_SERIAL, INPUT_HARD_DROP); break;
+		case 'p':
+		case 'P': input_post_event(INPUT_SOURCE_SERIAL, INPUT_PAUSE); break;
+		case 'j':
+		case 'J': input_post_event(INPUT_SOURCE_SERIAL, INPUT_CALIBRATE); break;
+	}
+}
+
+uint16_t input_dropped_event_count(void) {
+	uint16_t count;
+	uint8_t interrupts_were_on = bit_is_set(SREG, SREG_I);
+	cli();
+	count = dropped_events;
+	if(interrupts_were_on) {
+		sei();
+	}
+	return count;
+}
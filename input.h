@@ -0,0 +1,80 @@
+/*
+ * input.h
+ *
+ * Author: Elliot Randall
+ *
+ * A single queue of game input events fed by the button, serial and
+ * joystick interrupt handlers. While the queue is enabled, those
+ * interrupt handlers translate their input into game actions and add
+ * them here (instead of to their own queues) so the game loop can
+ * handle every pending input in one pass, in the order it arrived.
+ */
+
+#ifndef INPUT_H_
+#define INPUT_H_
+
+#include <stdint.h>
+
+/* Where an input event came from */
+#define INPUT_SOURCE_BUTTON 0
+#define INPUT_SOURCE_SERIAL 1
+#define INPUT_SOURCE_JOYSTICK 2
+#define INPUT_SOURCE_REPLAY 3
+
+/* Game actions */
+#define INPUT_MOVE_LEFT 0
+#define INPUT_MOVE_RIGHT 1
+#define INPUT_ROTATE 2
+#define INPUT_SOFT_DROP 3
+#define INPUT_HARD_DROP 4
+#define INPUT_PAUSE 5
+#define INPUT_CALIBRATE 6
+#define INPUT_GRAVITY_DROP 7	// Not from an input - recorded for replays
+
+/* An input event - its source, the game action and the clock tick 
+ * value (see timer0.h) when it happened.
+ */
+typedef struct {
+	uint8_t source;
+	uint8_t action;
+	uint32_t time;
+} InputEvent;
+
+/* Empty the queue and start (enable non-zero) or stop (enable zero)
+ * routing button, serial and joystick input to it. While stopped, 
+ * button pushes and serial characters go to their own queues as usual
+ * (see buttons.h and serialio.h) and joystick events are discarded.
+ */
+void input_set_enabled(uint8_t enable);
+
+/* Return non-zero if input is being routed to the event queue.
+ */
+uint8_t input_enabled(void);
+
+/* Discard any pending input events
+ */
+void input_empty_queue(void);
+
+/* Get the next input event. Returns 1 and fills in the event if there
+ * is one, 0 if the queue is empty.
+ */
+uint8_t input_get_event(InputEvent* event);
+
+/* Add an event to the queue, timestamped with the current clock tick
+ * value. Returns 1 on success, 0 if the queue is full (the event is
+ * discarded and counted). May be called from an interrupt handler.
+ */
+uint8_t input_post_event(uint8_t source, uint8_t action);
+
+/* Handle a character received on the serial port - escape sequences
+ * for the cursor keys and the single character commands are turned 
+ * into events. Called from the serial receive interrupt handler.
+ */
+void input_serial_char(char c);
+
+/* Return the number of events discarded because the queue was full
+ * (saturates at 65535).
+ */
+uint16_t input_dropped_event_count(void);
+
+#endif /* INPUT_H_ */
@@ -3,33 +3,211 @@
  *
  * Created: 5/23/2016 3:42:13 PM
  *  Author: Elliot
+ *
+ * The ADC runs in free-running mode with the conversion complete
+ * interrupt enabled. The interrupt handler alternates the mux between
+ * ADC0 (x axis) and ADC1 (y axis), low pass filters the samples for each
+ * axis and turns them into discrete direction events using a calibrated
+ * centre, a deadzone and some hysteresis. Direction events (and repeats
+ * while a direction is held) are posted to the input event queue (see
+ * input.h). The calibration is kept in EEPROM so it survives a reset.
  */ 
 
 #include <avr/io.h>
+#include <avr/interrupt.h>
+#include <avr/eeprom.h>
+
+#include "joystick.h"
+#include "timer0.h"
+#include "input.h"
+#include "eeprom_queue.h"
+
+/* Filter state for each axis - index 0 is x (ADC0), 1 is y (ADC1).
+ * Each is an exponential moving average of the samples, scaled up by 4:
+ *     state = state - state/4 + sample
+ * which settles at 4 x sample. Initialised to the centre value so the
+ * joystick reads as idle until the filter has settled.
+ */
+static volatile uint16_t filter_state[2] = { 511 << 2, 511 << 2 };
+
+/* In free-running mode the next conversion starts as soon as the last
+ * one completes, using whatever mux setting is in place at that time. A
+ * mux change made in the interrupt handler therefore only applies to the
+ * conversion after the one that has just started. We keep track of the
+ * channel being converted and the channel the mux is currently set to.
+ */
+static volatile uint8_t converting_channel;
+static volatile uint8_t next_channel;
+
+/* Calibration data - the centre of each axis, which is set with
+ * joystick_calibrate_centre(). This is stored in EEPROM at 
+ * JOYSTICK_CAL_EEPROM_ADDR and is only used from there if the magic byte
+ * matches.
+ */
+#define JOYSTICK_CAL_EEPROM_ADDR 200
+#define JOYSTICK_CAL_MAGIC 0xA5
+typedef struct {
+	uint8_t magic;
+	uint16_t centre[2];		// Filtered value when the joystick is at rest
+} JoystickCalibration;
+
+static JoystickCalibration calibration = {
+	JOYSTICK_CAL_MAGIC, { 511, 511 }
+};
 
+/* Distance from the centre to register a direction, below and above the
+ * centre of each axis. With the default centre these give the old fixed
+ * thresholds - left at 200, right at 900, down at 100 and up at 900. A
+ * direction is released once the axis is HYSTERESIS back inside the 
+ * deadzone.
+ */
+static const uint16_t deadzone_below[2] = { 311, 411 };
+static const uint16_t deadzone_above[2] = { 389, 389 };
+#define HYSTERESIS 40
+
+/* The direction each axis is currently held in (JOYSTICK_NONE if the
+ * axis is inside its deadzone). Updated by the interrupt handler.
+ */
+static volatile uint8_t held_direction[2];
+
+/* Game action for each direction (indexed by JOYSTICK_LEFT etc.) */
+static const uint8_t direction_action[] = {
+	0, INPUT_MOVE_LEFT, INPUT_MOVE_RIGHT, INPUT_ROTATE, INPUT_SOFT_DROP
+};
+
+/* Auto-repeat state for each axis - the (16 bit) clock tick value at 
+ * which the held direction is next repeated. The first repeat comes 
+ * after a longer delay. Only used by the interrupt handler. A direction
+ * is only held for long enough for the clock to wrap around if it keeps
+ * repeating, so the deadline is never more than an interval away.
+ */
+#define JOYSTICK_REPEAT_DELAY 300
+#define JOYSTICK_REPEAT_INTERVAL 100
+static uint16_t next_repeat_time[2];
 
 void init_joystick(void) {
+	// Load the calibration from EEPROM if it has been saved before
+	JoystickCalibration saved;
+	eeprom_read_block(&saved, (const void*)JOYSTICK_CAL_EEPROM_ADDR, 
+			sizeof(saved));
+	if(saved.magic == JOYSTICK_CAL_MAGIC) {
+		calibration = saved;
+	}
+	
+	held_direction[0] = held_direction[1] = JOYSTICK_NONE;
+	
+	// AVCC reference, start with channel ADC0
 	ADMUX = (1 << REFS0);
-	ADCSRA = (1 << ADPS1) | (1 << ADPS2) | (1 << ADEN);
+	converting_channel = 0;
+	
+	// Free running mode (no auto trigger source selected)
+	ADCSRB = 0;
+	
+	// Enable the ADC with a /128 prescaler, auto triggering and the
+	// conversion complete interrupt, and start the first conversion.
+	// This gives about 4800 conversions per second, i.e. 2400 per axis, 
+	// which is plenty for the filter to average over.
+	ADCSRA = (1 << ADEN) | (1 << ADSC) | (1 << ADATE) | (1 << ADIE) 
+			| (1 << ADPS2) | (1 << ADPS1) | (1 << ADPS0);
+	
+	// The first conversion has latched ADC0 - the one after it
+	// should sample ADC1
+	ADMUX |= (1 << MUX0);
+	next_channel = 1;
 }
 
 //this method takes a 0 or 1 - 0 for x, 1 for y
 uint16_t get_value(uint8_t x_or_y) {
 	uint16_t value;
-	// Set the ADC mux to choose ADC0 if x_or_y is 0, ADC1 if x_or_y is 1
-	if(x_or_y == 0) {
-		ADMUX &= ~(1 << MUX0);
-		} else {
-		ADMUX |= (1 << MUX0);
-	}
-	//Start the conversion
-	ADCSRA |= (1 << ADSC);
-		
-	while(ADCSRA & (1<<ADSC)) {
-		; /* Wait until conversion finished */
+	
+	// The filter state is 16 bits so we turn interrupts off while copying
+	// it to make sure the ADC interrupt doesn't update it half way through
+	uint8_t interrupts_were_on = bit_is_set(SREG, SREG_I);
+	cli();
+	value = filter_state[x_or_y & 1];
+	if(interrupts_were_on) {
+		sei();
 	}
-	value = ADC;
-	return value; 
+	return value >> 2; 
+}
+
+uint8_t joystick_direction(uint8_t x_or_y) {
+	return held_direction[x_or_y & 1];
 }
 
+void joystick_calibrate_centre(void) {
+	// The interrupt handler reads the calibration so we make the
+	// change with interrupts off
+	uint8_t interrupts_were_on = bit_is_set(SREG, SREG_I);
+	cli();
+	calibration.centre[0] = filter_state[0] >> 2;
+	calibration.centre[1] = filter_state[1] >> 2;
+	calibration.magic = JOYSTICK_CAL_MAGIC;
+	if(interrupts_were_on) {
+		sei();
+	}
+	// Saved in the background - only bytes which have changed are written
+	eeprom_queue_write(JOYSTICK_CAL_EEPROM_ADDR, &calibration, 
+			sizeof(calibration));
+}
 
+/* Interrupt handler which fires when an ADC conversion completes. The
+ * following conversion has already started on next_channel, so we set
+ * the mux up for the conversion after that. We then update the filter
+ * for the axis just converted and check whether it has moved into or
+ * out of a direction.
+ */
+ISR(ADC_vect) {
+	uint8_t axis = converting_channel;
+	uint16_t sample = ADC;
+	
+	converting_channel = next_channel;
+	next_channel ^= 1;
+	if(next_channel) {
+		ADMUX |= (1 << MUX0);
+	} else {
+		ADMUX &= ~(1 << MUX0);
+	}
+	
+	uint16_t state = filter_state[axis];
+	state = state - (state >> 2) + sample;
+	filter_state[axis] = state;
+	
+	int16_t offset = (int16_t)(state >> 2) - (int16_t)calibration.centre[axis];
+	uint16_t distance = (offset < 0) ? -offset : offset;
+	uint16_t deadzone = (offset < 0) ? deadzone_below[axis] 
+			: deadzone_above[axis];
+	
+	if(held_direction[axis] == JOYSTICK_NONE) {
+		if(distance > deadzone) {
+			// Moved out of the deadzone - x low is left, y high is up
+			uint8_t direction;
+			if(axis == 0) {
+				direction = (offset < 0) ? JOYSTICK_LEFT : JOYSTICK_RIGHT;
+			} else {
+				direction = (offset < 0) ? JOYSTICK_DOWN : JOYSTICK_UP;
+			}
+			held_direction[axis] = direction;
+			next_repeat_time[axis] = get_clock_ticks16() + 
+					JOYSTICK_REPEAT_DELAY;
+			if(input_enabled()) {
+				input_post_event(INPUT_SOURCE_JOYSTICK, 
+						direction_action[direction]);
+			}
+		}
+	} else if(distance < deadzone - HYSTERESIS) {
+		// Back far enough inside the deadzone to count as released
+		held_direction[axis] = JOYSTICK_NONE;
+	} else {
+		// Still held - repeat the direction after the initial delay and
+		// then at the repeat interval
+		uint16_t now = get_clock_ticks16();
+		if(ticks16_reached(now, next_repeat_time[axis])) {
+			next_repeat_time[axis] = now + JOYSTICK_REPEAT_INTERVAL;
+			if(input_enabled()) {
+				input_post_event(INPUT_SOURCE_JOYSTICK, 
+						direction_action[held_direction[axis]]);
+			}
+		}
+	}
+}
@@ -9,10 +9,45 @@
 #ifndef JOYSTICK_H_
 #define JOYSTICK_H_
 
-uint16_t get_value(uint8_t x_or_y);
+#include <stdint.h>
+
+/* Joystick directions. Left/right come from the x axis, up/down from
+ * the y axis.
+ */
+#define JOYSTICK_NONE 0
+#define JOYSTICK_LEFT 1
+#define JOYSTICK_RIGHT 2
+#define JOYSTICK_UP 3
+#define JOYSTICK_DOWN 4
+
+/* Set up the ADC to sample ADC0 (x) and ADC1 (y) continuously in
+ * free-running mode and load the calibration from EEPROM. Note: 
+ * interrupts will need to be enabled globally for the samples to 
+ * be updated.
+ */
 void init_joystick(void);
 
+/* Return the latest filtered value (0 to 1023) for the given axis - 
+ * 0 for x, 1 for y. This does not wait for a conversion.
+ */
+uint16_t get_value(uint8_t x_or_y);
+
+/* Return the direction the given axis (0 for x, 1 for y) is currently
+ * held in, or JOYSTICK_NONE if it is inside its deadzone. Direction
+ * events (with auto-repeats after 300ms and then every 100ms while a
+ * direction is held) are posted to the input event queue.
+ */
+uint8_t joystick_direction(uint8_t x_or_y);
 
+/* Number of bytes of EEPROM written when the calibration is saved - a
+ * magic byte and the 16 bit centre of each axis
+ */
+#define JOYSTICK_CALIBRATION_SIZE 5
 
+/* Record the current position of the joystick as the centre position
+ * for both axes and save the calibration to EEPROM. The joystick should
+ * be at rest when this is called.
+ */
+void joystick_calibrate_centre(void);
 
-#endif /* JOYSTICK_H_ */
\ No newline at end of file
+#endif /* JOYSTICK_H_ */
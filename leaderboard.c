@@ -0,0 +1,139 @@
+/*
+ * leaderboard.c
+ *
+ * Author: Elliot Randall
+ *
+ * See leaderboard.h for details.
+ */
+
+#include <avr/eeprom.h>
+#include <avr/pgmspace.h>
+#include <stdio.h>
+
+#include "leaderboard.h"
+#include "eeprom_store.h"
+#include "terminalio.h"
+
+/* The table as saved in the EEPROM store. Entries from count onwards are
+ * unused. The scores come first so that there is no padding between 
+ * the fields.
+ */
+#define LEADERBOARD_RECORD_VERSION 2
+typedef struct {
+	uint32_t scores[LEADERBOARD_SIZE];
+	char names[LEADERBOARD_SIZE][2];
+	uint8_t count;
+} LeaderboardRecord;
+
+static LeaderboardRecord table;
+
+/* Earlier versions of the program saved five 16 bit scores - first in
+ * fixed locations at the start of EEPROM (with each letter of the names
+ * stored as a word), then as version 1 records in the EEPROM store. 
+ * Unused entries had a score of 0xFFFF.
+ */
+#define OLD_RECORD_VERSION 1
+#define OLD_SIZE 5
+#define OLD_UNUSED_SCORE 0xFFFF
+typedef struct {
+	uint16_t scores[OLD_SIZE];
+	char names[OLD_SIZE][2];
+} OldRecord;
+
+#define OLD_TABLE_NAMES_ADDRESS 100
+typedef struct {
+	uint16_t scores[OLD_SIZE];
+	uint8_t unused[OLD_TABLE_NAMES_ADDRESS - OLD_SIZE * sizeof(uint16_t)];
+	uint16_t names[OLD_SIZE][2];
+} OldTable;
+
+static void add_old_entry(uint16_t score, char first, char second) {
+	if(score == OLD_UNUSED_SCORE || table.count >= LEADERBOARD_SIZE) {
+		return;
+	}
+	table.scores[table.count] = score;
+	table.names[table.count][0] = first;
+	table.names[table.count][1] = second;
+	table.count++;
+}
+
+void leaderboard_load(void) {
+	if(store_load(LEADERBOARD_RECORD_VERSION, &table, sizeof(table)) &&
+			table.count <= LEADERBOARD_SIZE) {
+		return;
+	}
+	
+	// Convert an old table (already in order)
+	table.count = 0;
+	OldRecord record;
+	if(store_load(OLD_RECORD_VERSION, &record, sizeof(record))) {
+		for(uint8_t i = 0; i < OLD_SIZE; i++) {
+			add_old_entry(record.scores[i], record.names[i][0], 
+					record.names[i][1]);
+		}
+	} else {
+		OldTable old_table;
+		eeprom_read_block(&old_table, (const void*)0, sizeof(old_table));
+		for(uint8_t i = 0; i < OLD_SIZE; i++) {
+			add_old_entry(old_table.scores[i], old_table.names[i][0], 
+					old_table.names[i][1]);
+		}
+	}
+}
+
+uint8_t leaderboard_count(void) {
+	return table.count;
+}
+
+uint32_t leaderboard_score(uint8_t position) {
+	return table.scores[position];
+}
+
+const char* leaderboard_name(uint8_t position) {
+	return table.names[position];
+}
+
+int8_t leaderboard_position(uint32_t score) {
+	for(uint8_t i = 0; i < table.count; i++) {
+		if(score > table.scores[i]) {
+			return i;
+		}
+	}
+	if(table.count < LEADERBOARD_SIZE) {
+		return table.count;
+	}
+	return -1;
+}
+
+void leaderboard_add(uint32_t score, const char name[2]) {
+	int8_t position = leaderboard_position(score);
+	if(position < 0) {
+		return;
+	}
+	
+	// Move lower entries down one place (the lowest drops off the end if
+	// the table is full)
+	if(table.count < LEADERBOARD_SIZE) {
+		table.count++;
+	}
+	for(uint8_t i = table.count - 1; i > position; i--) {
+		table.scores[i] = table.scores[i - 1];
+		table.names[i][0] = table.names[i - 1][0];
+		table.names[i][1] = table.names[i - 1][1];
+	}
+	table.scores[position] = score;
+	table.names[position][0] = name[0];
+	table.names[position][1] = name[1];
+	
+	store_save(LEADERBOARD_RECORD_VERSION, &table, sizeof(table));
+}
+
+void leaderboard_display(void) {
+	move_cursor(0,0); 
+	printf_P(PSTR("HIGHSCORES\n"));
+	printf_P(PSTR("__________\n"));	
+	for(uint8_t i = 0; i < table.count; i++) {
+		printf_P(PSTR("%c%c: %lu\n"), table.names[i][0], table.names[i][1], 
+				(unsigned long)table.scores[i]);
+	}
+}
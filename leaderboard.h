@@ -0,0 +1,50 @@
+/*
+ * leaderboard.h
+ *
+ * Author: Elliot Randall
+ *
+ * The high score table. The table is loaded from EEPROM once (see 
+ * leaderboard_load()) and kept in RAM, sorted from highest score down.
+ * It is only written back to EEPROM (using the EEPROM store - see 
+ * eeprom_store.h) when an entry is added.
+ */
+
+#ifndef LEADERBOARD_H_
+#define LEADERBOARD_H_
+
+#include <stdint.h>
+
+/* Number of entries in the table */
+#define LEADERBOARD_SIZE 8
+
+/* Load the table from EEPROM. Tables saved by earlier versions of the 
+ * program are converted.
+ */
+void leaderboard_load(void);
+
+/* Return the number of entries in the table (0 to LEADERBOARD_SIZE).
+ */
+uint8_t leaderboard_count(void);
+
+/* Return the score and name (two letters) of the given entry (0 is the
+ * highest score).
+ */
+uint32_t leaderboard_score(uint8_t position);
+const char* leaderboard_name(uint8_t position);
+
+/* Return the position the given score would take in the table, or -1 if
+ * it doesn't make the table.
+ */
+int8_t leaderboard_position(uint32_t score);
+
+/* Add the given score and name (two letters) to the table in the 
+ * position given by leaderboard_position(), and save the table. Does 
+ * nothing if the score doesn't make the table.
+ */
+void leaderboard_add(uint32_t score, const char name[2]);
+
+/* Print the table to the terminal.
+ */
+void leaderboard_display(void);
+
+#endif /* LEADERBOARD_H_ */
@@ -0,0 +1,153 @@
+/*
+ * placement_log.c
+ *
+ * Author: Elliot Randall
+ *
+ * See placement_log.h for details.
+ */
+
+#include <avr/eeprom.h>
+#include <avr/pgmspace.h>
+#include <stdio.h>
+
+#include "placement_log.h"
+#include "eeprom_queue.h"
+
+/* Each slot starts with this header, followed by the placements. The
+ * fields are ordered so there is no padding. length is 
+ * PLACEMENT_LOG_UNFINISHED until the game is over.
+ */
+#define PLACEMENT_LOG_VERSION 1
+#define PLACEMENT_LOG_UNFINISHED 0xFFFF
+typedef struct {
+	uint8_t version;
+	uint8_t sequence;
+	uint16_t length;
+	uint32_t seed;
+	uint32_t score;
+} PlacementLogHeader;
+
+_Static_assert(sizeof(PlacementLogHeader) == PLACEMENT_LOG_HEADER_SIZE,
+		"PLACEMENT_LOG_HEADER_SIZE doesn't match the header");
+
+#define MAX_PLACEMENT_BYTES (PLACEMENT_LOG_SLOT_SIZE - \
+		sizeof(PlacementLogHeader))
+#define SLOT_OFFSET(slot) (PLACEMENT_LOG_ADDRESS + \
+		(uint16_t)(slot) * PLACEMENT_LOG_SLOT_SIZE)
+
+static uint8_t slot;
+static uint8_t logging;
+static PlacementLogHeader header;
+
+/* The slot holding the latest game in the log and its sequence number.
+ * These are found when the log is loaded and kept up to date as games 
+ * are started, so the EEPROM doesn't need to be read (and the EEPROM
+ * queue flushed) for each game.
+ */
+static uint8_t latest_slot = PLACEMENT_LOG_SLOTS - 1;
+static uint8_t latest_sequence;
+
+static void read_header(uint8_t slot, PlacementLogHeader* slot_header) {
+	eeprom_read_block(slot_header, (const void*)(uintptr_t)SLOT_OFFSET(slot),
+			sizeof(PlacementLogHeader));
+}
+
+void placement_log_load(void) {
+	PlacementLogHeader slot_header;
+	uint8_t found = 0;
+	
+	// Find the latest game in the log (or use the last slot if the log
+	// is empty)
+	latest_slot = PLACEMENT_LOG_SLOTS - 1;
+	latest_sequence = 0;
+	eeprom_queue_flush();
+	for(uint8_t i = 0; i < PLACEMENT_LOG_SLOTS; i++) {
+		read_header(i, &slot_header);
+		if(slot_header.version != PLACEMENT_LOG_VERSION) {
+			continue;
+		}
+		// Sequence numbers wrap around, so compare them by difference
+		if(!found || (int8_t)(slot_header.sequence - latest_sequence) > 0) {
+			latest_sequence = slot_header.sequence;
+			latest_slot = i;
+			found = 1;
+		}
+	}
+}
+
+void placement_log_start(uint32_t seed) {
+	// Replace the game after the latest (i.e. the oldest), which then 
+	// becomes the latest
+	slot = (latest_slot + 1) % PLACEMENT_LOG_SLOTS;
+	latest_slot = slot;
+	latest_sequence++;
+	
+	header.version = PLACEMENT_LOG_VERSION;
+	header.sequence = latest_sequence;
+	header.length = 0;
+	header.seed = seed;
+	header.score = 0;
+	
+	// The length is only written when the game is over
+	PlacementLogHeader unfinished = header;
+	unfinished.length = PLACEMENT_LOG_UNFINISHED;
+	eeprom_queue_write(SLOT_OFFSET(slot), &unfinished, sizeof(unfinished));
+	logging = 1;
+}
+
+void placement_log_add(uint8_t blocknum, uint8_t rotation, uint8_t column,
+		uint8_t row, uint8_t dropped_straight) {
+	uint8_t bytes[2];
+	uint8_t length = 1;
+	
+	if(!logging) {
+		return;
+	}
+	if(dropped_straight) {
+		bytes[0] = PLACEMENT_BYTE(blocknum, rotation, column);
+	} else {
+		bytes[0] = PLACEMENT_BYTE(PLACEMENT_ROW_FOLLOWS, rotation, column);
+		bytes[1] = row;
+		length = 2;
+	}
+	if(header.length + length > MAX_PLACEMENT_BYTES) {
+		return;
+	}
+	eeprom_queue_write(SLOT_OFFSET(slot) + sizeof(header) + header.length,
+			bytes, length);
+	header.length += length;
+}
+
+void placement_log_end(uint32_t score) {
+	if(!logging) {
+		return;
+	}
+	header.score = score;
+	eeprom_queue_write(SLOT_OFFSET(slot), &header, sizeof(header));
+	logging = 0;
+}
+
+void placement_log_dump(void) {
+	PlacementLogHeader slot_header;
+	
+	eeprom_queue_flush();
+	for(uint8_t i = 1; i <= PLACEMENT_LOG_SLOTS; i++) {
+		// Start with the slot after the latest game (the oldest)
+		uint8_t dump_slot = (latest_slot + i) % PLACEMENT_LOG_SLOTS;
+		read_header(dump_slot, &slot_header);
+		if(slot_header.version != PLACEMENT_LOG_VERSION || 
+				slot_header.length == PLACEMENT_LOG_UNFINISHED ||
+				slot_header.length > MAX_PLACEMENT_BYTES) {
+			continue;
+		}
+		printf_P(PSTR("\x1b_L%u,%lx,%lu,"), slot_header.sequence, 
+				(unsigned long)slot_header.seed, 
+				(unsigned long)slot_header.score);
+		const uint8_t* address = (const uint8_t*)(uintptr_t)
+				(SLOT_OFFSET(dump_slot) + sizeof(slot_header));
+		for(uint16_t j = 0; j < slot_header.length; j++) {
+			printf_P(PSTR("%02x"), eeprom_read_byte(address++));
+		}
+		printf_P(PSTR("\x1b\\"));
+	}
+}
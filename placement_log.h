@@ -0,0 +1,79 @@
+/*
+ * placement_log.h
+ *
+ * Author: Elliot Randall
+ *
+ * Keeps a compact log of where each block was placed in the last 
+ * PLACEMENT_LOG_SLOTS games in EEPROM, along with the block generator 
+ * seed and the final score. This is enough to rebuild each game (see 
+ * host/placements.c) - e.g. to use real games for performance testing.
+ *
+ * Each placement is normally one byte: the block number (bits 7-5), 
+ * rotation (bits 4-3) and column (bits 2-0) of the block when it was 
+ * fixed to the board. The block is then taken to have dropped straight
+ * down from the top of the board. If it couldn't have (e.g. it was slid
+ * under an overhang), the block number is given as PLACEMENT_ROW_FOLLOWS
+ * and the next byte is the row. (The block number is known from the 
+ * seed anyway.) A game's placements are written as each block is fixed,
+ * through the EEPROM queue (see eeprom_queue.h).
+ *
+ * The log is dumped to the serial port as one Application Program 
+ * Command string per game (see record.h):
+ *     ESC _ L<sequence>,<seed in hex>,<score>,<placements in hex> ESC \
+ */
+
+#ifndef PLACEMENT_LOG_H_
+#define PLACEMENT_LOG_H_
+
+#include <stdint.h>
+#include "board.h"
+
+/* A column must fit in 3 bits and a row in a byte */
+#if BOARD_WIDTH > 8 || BOARD_ROWS > 256
+#error "The placement log only supports boards up to 8 wide and 256 high"
+#endif
+
+#define PLACEMENT_LOG_ADDRESS 512
+#define PLACEMENT_LOG_SLOTS 2
+#define PLACEMENT_LOG_SLOT_SIZE 256
+
+/* Bytes written at the start and end of each game (the slot's header),
+ * and at most for each placement
+ */
+#define PLACEMENT_LOG_HEADER_SIZE 12
+#define PLACEMENT_LOG_MAX_PLACEMENT_SIZE 2
+
+#define PLACEMENT_ROW_FOLLOWS 7
+#define PLACEMENT_BYTE(blocknum, rotation, column) \
+		(((blocknum) << 5) | ((rotation) << 3) | (column))
+#define PLACEMENT_BLOCKNUM(byte) ((byte) >> 5)
+#define PLACEMENT_ROTATION(byte) (((byte) >> 3) & 3)
+#define PLACEMENT_COLUMN(byte) ((byte) & 7)
+
+/* Find the latest game in the log. To be called once at start up, 
+ * before any other placement log function.
+ */
+void placement_log_load(void);
+
+/* Start logging a new game played with the given seed. This replaces
+ * the oldest game in the log. EEPROM is only written (through the 
+ * queue), so this never waits for the queue to empty.
+ */
+void placement_log_start(uint32_t seed);
+
+/* Log the placement of a block. dropped_straight should be 1 if the 
+ * block could have dropped straight down to its row from the top of the
+ * board. Placements which don't fit in the log are not kept.
+ */
+void placement_log_add(uint8_t blocknum, uint8_t rotation, uint8_t column,
+		uint8_t row, uint8_t dropped_straight);
+
+/* Finish logging the game, noting the final score.
+ */
+void placement_log_end(uint32_t score);
+
+/* Write each finished game in the log to the serial port, oldest first.
+ */
+void placement_log_dump(void);
+
+#endif /* PLACEMENT_LOG_H_ */
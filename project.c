@@ -19,28 +19,142 @@
 #include "serialio.h"
 #include "terminalio.h"
 #include "score.h"
+#include "leaderboard.h"
+#include "eeprom_queue.h"
+#include "eeprom_store.h"
+#include "placement_log.h"
+#include "snapshot.h"
 #include "timer0.h"
 #include "game.h"
 #include "timer2.h"
 #include "joystick.h"
+#include "input.h"
+#include "record.h"
+#include "scheduler.h"
+#include "timer1.h"
+#include "sevenseg.h"
+#include "blocks.h"
+#include "autoplay.h"
 
 #define F_CPU 8000000L
-#include <util/delay.h>
 #include <avr/eeprom.h>
 
 // Function prototypes - these are defined below (after main()) in the order
 // given here
+static void enter_state(uint8_t new_state);
+static int8_t add_task(TaskFunction function, const char* name,
+		uint16_t period, uint16_t deadline);
 void initialise_hardware(void);
 void splash_screen(void);
+static void splash_scroll_task(void);
+static void splash_text_task(void);
+static void splash_button_task(void);
 void new_game(void);
 void play_game(void);
+static void end_game(void);
+static void block_locked(const FallingBlock* block, uint8_t dropped_straight);
+static void autoplay_block_locked(const FallingBlock* block, 
+		uint8_t dropped_straight);
+static void save_snapshot(void);
+static void input_task(void);
+static void gravity_task(void);
+static void autoplay_task(void);
+static void display_task(void);
+static void status_task(void);
+static void show_seven_seg_value(void);
+static void note_first_frame(void);
+static void print_boot_time(void);
+uint8_t handle_game_action(uint8_t action);
+void pause_game(void);
+void resume_game(void);
+static void start_name_entry(void);
+static void name_entry_task(void);
 void handle_game_over(void);
+static void game_over_task(void);
 void handle_new_lap(void);
 
-// ASCII code for Escape character
-#define ESCAPE_CHAR 27 
+// The program moves between these states. Each state runs as a set of
+// tasks (see scheduler.h) so that nothing waits for input - a task 
+// sets next_state to move to another state, which main() then enters.
+#define STATE_SPLASH 0
+#define STATE_PLAYING 1
+#define STATE_NAME_ENTRY 2
+#define STATE_GAME_OVER 3
+static uint8_t state;
+static uint8_t next_state;
+static uint32_t state_entered;	// Clock tick value when state was entered
 
-int press_sequence = 0; 
+// Time (in ms) before name entry gives up waiting for a name, before
+// the game over screen goes back to the splash screen, and before the
+// splash screen starts the computer playing (attract mode)
+#define NAME_ENTRY_TIMEOUT 30000UL
+#define GAME_OVER_TIMEOUT 60000UL
+#define SPLASH_AUTOPLAY_TIMEOUT 20000UL
+
+// Time (in ms) between the computer player's actions
+#define AUTOPLAY_ACTION_INTERVAL 25
+
+// The game being played (or last played), and state shared by the 
+// tasks which make up play_game()
+static GameState game;
+static uint8_t game_over;
+static uint8_t paused;
+static uint32_t pause_start;
+static int8_t gravity_task_id;
+
+// Set if the current game is a replay of the last recorded game
+static uint8_t replaying = 0;
+
+// Set if the computer is playing the current game (see autoplay.h), 
+// where the current block is to go, and whether a place needs to be 
+// chosen for a new block
+static uint8_t autoplaying = 0;
+static AutoplayMove autoplay_move;
+static uint8_t autoplay_choice_due;
+
+// Set if the next game should carry on from the saved snapshot of a 
+// game which was interrupted by a reset, and set by block_locked() when
+// the snapshot needs to be saved
+static uint8_t resuming = 0;
+static uint8_t snapshot_due = 0;
+
+// The most bytes queued for EEPROM after a snapshot is saved and before
+// the next one can be: a placement, then at the end of the game the 
+// placement log header, clearing the snapshot and saving the high 
+// scores (a store slot), along with a joystick calibration at any time.
+// When a snapshot is saved there are at most a few bytes (so a few 
+// runs) left in the queue, and these add at most 8 runs of their own.
+#define EEPROM_BYTES_AFTER_SNAPSHOT (PLACEMENT_LOG_MAX_PLACEMENT_SIZE + \
+		PLACEMENT_LOG_HEADER_SIZE + 1 + STORE_SLOT_SIZE + \
+		JOYSTICK_CALIBRATION_SIZE)
+_Static_assert(SNAPSHOT_SIZE + EEPROM_BYTES_AFTER_SNAPSHOT <= 
+		EEPROM_QUEUE_SIZE, "EEPROM queue is too small for a game over");
+_Static_assert(EEPROM_QUEUE_SIZE - SNAPSHOT_SIZE - 
+		EEPROM_BYTES_AFTER_SNAPSHOT + 8 <= EEPROM_QUEUE_RUNS,
+		"EEPROM queue has too few runs for a game over");
+
+// Splash screen message colour
+static PixelColour splash_colour;
+
+// Time from start up until the first frame was sent to the LED matrix 
+// (in microseconds) - 0 until then
+static uint32_t first_frame_time;
+
+// High score name entry
+static int8_t name_entry_task_id;
+static int8_t high_score_position;
+static char name[2];
+static uint8_t name_length;
+
+// What the seven segment display shows during a game (changed from the
+// game over screen)
+#define SHOW_ROWS_CLEARED 0
+#define SHOW_SCORE 1
+#define SHOW_LEVEL 2
+#define SHOW_SPEED 3
+#define NUM_SHOW_OPTIONS 4
+static uint8_t seven_seg_shows = SHOW_ROWS_CLEARED;
+static uint8_t seven_seg_brightness = 100;
 
 /////////////////////////////// main //////////////////////////////////
 int main(void) {
@@ -48,20 +162,75 @@ int main(void) {
 	// interrupts.
 	initialise_hardware();
 	
-	// Show the splash screen message. Returns when display
-	// is complete
-	splash_screen();
-	//write the highscores to the game
-	write_eeprom_to_game(); 
-	write_eeprom_to_game_names();
+	// Load the high score table into RAM, and find where the placement
+	// log is up to
+	leaderboard_load();
+	placement_log_load();
 	
+	// Carry on a game which was interrupted by a reset if there is one.
+	// Otherwise start with the splash screen - or go straight into a game
+	// if a button is held down at start up. Then run the tasks for each 
+	// state as they fall due, moving between states when a task asks to.
+	// Buttons which changed during their debounce time are checked again
+	// between tasks.
+	resuming = snapshot_load();
+	enter_state((resuming || (PINB & 0x0F)) ? STATE_PLAYING : STATE_SPLASH);
 	while(1) {
-		new_game();
-		play_game();
-		handle_game_over();
+		scheduler_run_pending();
+		button_check_pending();
+		if(next_state != state) {
+			enter_state(next_state);
+		}
 	}
 }
 
+/*
+ * Set up the given state. Each state replaces the tasks of the last, 
+ * except that the name entry and game over states keep the (now idle)
+ * game tasks so that their statistics can still be shown.
+ */
+static void enter_state(uint8_t new_state) {
+	state = new_state;
+	next_state = new_state;
+	state_entered = get_clock_ticks();
+	switch(new_state) {
+		case STATE_SPLASH:
+			scheduler_clear();
+			splash_screen();
+			break;
+		case STATE_PLAYING:
+			scheduler_clear();
+			new_game();
+			play_game();
+			break;
+		case STATE_NAME_ENTRY:
+			start_name_entry();
+			break;
+		case STATE_GAME_OVER:
+			handle_game_over();
+			break;
+	}
+}
+
+/*
+ * Add a task for the current state (see scheduler_add_task()). The 
+ * states never have more than SCHEDULER_MAX_TASKS tasks between them, 
+ * but if a task can't be added the state can't work without it, so we
+ * report it and stop rather than carry on.
+ */
+static int8_t add_task(TaskFunction function, const char* name,
+		uint16_t period, uint16_t deadline) {
+	int8_t task = scheduler_add_task(function, name, period, deadline);
+	if(task < 0) {
+		printf_P(PSTR("\nNo room for task "));
+		printf_P(name);
+		while(1) {
+			;
+		}
+	}
+	return task;
+}
+
 void initialise_hardware(void) {
 	ledmatrix_setup();
 	init_button_interrupts();
@@ -76,20 +245,48 @@ void initialise_hardware(void) {
 	
 	// Set up our main timer to give us an interrupt every millisecond
 	init_timer0();
-	//write_eeprom_to_game();
-	//Set up sound Timer
+	
+	// Seven segment display is refreshed from timer 0 compare B
+	init_seven_seg();
+	
+	// Start sampling the joystick in the background
+	init_joystick();
+	// Set up the sound effect timer
+	init_sound();
 	
 	// Turn on global interrupts
 	sei();
 }
 
 void splash_screen(void) {
+	// Output the scrolling message to the LED matrix (red the first
+	// time through). We scroll every 130ms, starting straight away,
+	// until a button is pushed (or, if none is, until the computer 
+	// starts playing). The terminal text is written after the first 
+	// column has been displayed.
+	ledmatrix_clear();
+	seven_seg_enable(0);
+	autoplaying = 0;
+	splash_colour = COLOUR_RED;
+	set_scrolling_display_text("s4356917", splash_colour);
+	empty_button_queue();
+	scheduler_trigger(add_task(splash_scroll_task, PSTR("scroll"),
+			130, 20));
+	scheduler_trigger(add_task(splash_text_task, PSTR("text"), 
+			0, 100));
+	add_task(splash_button_task, PSTR("buttons"), 10, 10);
+}
+
+/*
+ * Write the splash screen text and high score table to the terminal.
+ */
+static void splash_text_task(void) {
 	// Reset display attributes and clear terminal screen then output a message
 	set_display_attribute(TERM_RESET);
 	clear_terminal();
 	
 	hide_cursor();	// We don't need to see the cursor when we're just doing output
-	display_high_score();
+	leaderboard_display();
 	move_cursor(10,10);
 	printf_P(PSTR("s4356917"));
 	
@@ -97,331 +294,435 @@ void splash_screen(void) {
 	set_display_attribute(FG_GREEN);	// Make the text green
 	printf_P(PSTR("CSSE2010/7201 Tetris Project by Elliot Randall"));	
 	set_display_attribute(FG_WHITE);	// Return to default colour (White)
-	
-	// Output the scrolling message to the LED matrix
-	// and wait for a push button to be pushed.
-	ledmatrix_clear();
-	
-	// Red message the first time through
-	PixelColour colour = COLOUR_RED; 
-	while(1) { 
-		set_scrolling_display_text("s4356917", colour);
-		// Scroll the message until it has scrolled off the 
-		// display or a button is pushed. We pause for 130ms between each scroll.
-		while(scroll_display()) {
-			_delay_ms(130);
-			if(button_pushed() != -1) {
-				// A button has been pushed
-				return;
-			}
-		}
-		// Message has scrolled off the display. Change colour
-		// to a random colour and scroll again.
-		switch(random()%4) {
-			case 0: colour = COLOUR_LIGHT_ORANGE; break;
-			case 1: colour = COLOUR_RED; break;
-			case 2: colour = COLOUR_YELLOW; break;
-			case 3: colour = COLOUR_LIGHT_GREEN; break;
-		}
+	print_boot_time();
+}
+
+/*
+ * Scroll the splash screen message one column. Once it has scrolled 
+ * off the display, start it again in a random colour.
+ */
+static void splash_scroll_task(void) {
+	uint8_t scrolling = scroll_display();
+	note_first_frame();
+	if(scrolling) {
+		return;
+	}
+	switch(random()%4) {
+		case 0: splash_colour = COLOUR_LIGHT_ORANGE; break;
+		case 1: splash_colour = COLOUR_RED; break;
+		case 2: splash_colour = COLOUR_YELLOW; break;
+		case 3: splash_colour = COLOUR_LIGHT_GREEN; break;
+	}
+	set_scrolling_display_text("s4356917", splash_colour);
+}
+
+/*
+ * Start a game when a button is pushed. If no button is pushed for a 
+ * while, let the computer play.
+ */
+static void splash_button_task(void) {
+	if(button_pushed() != -1) {
+		next_state = STATE_PLAYING;
+	} else if(get_clock_ticks() - state_entered >= SPLASH_AUTOPLAY_TIMEOUT) {
+		autoplaying = 1;
+		next_state = STATE_PLAYING;
 	}
 }
 
 void new_game(void) {
-	// Initialise the game and display
-	init_game();
+	// Carry on from the snapshot if asked to. We don't know the seed the
+	// game was started with, so it can't be replayed or logged.
+	if(resuming) {
+		resuming = 0;
+		game.visible = 1;
+		if(restore_game_snapshot(&game, snapshot_game())) {
+			record_start_resumed();
+			set_lock_handler(&game, block_locked);
+			empty_button_queue();
+			clear_serial_input_buffer();
+			return;
+		}
+	}
+	
+	// Seed the block generator. A replay uses the seed the recorded game
+	// was played with. Otherwise we mix the time the game is started at
+	// with the joystick readings, and start a new recording (unless the
+	// computer is playing).
+	uint32_t seed;
+	if(replaying) {
+		seed = record_seed();
+	} else {
+		seed = get_clock_ticks() ^ ((uint32_t)get_value(0) << 16) ^ get_value(1);
+		if(!autoplaying) {
+			record_start(seed);
+			placement_log_start(seed);
+		}
+	}
+	set_lock_handler(&game, replaying ? 0 : 
+			autoplaying ? autoplay_block_locked : block_locked);
+	game.visible = 1;
+	
+	// Initialise the game (including the score) and display
+	init_game(&game, seed);
 	
 	// Clear the serial terminal
 	//clear_terminal();
 	
-	// Initialise the score
-	init_score();
-	reset_current_speed(); 
-	
 	// Delete any pending button pushes or serial input
 	empty_button_queue();
 	clear_serial_input_buffer();
 }
 
 void play_game(void) {
-	init_joystick();
-	uint16_t adc_value = 511; 
-	int currentSpeed = 600; 
-	uint32_t last_drop_time;
-	int8_t button;
-	char serial_input, escape_sequence_char;
-	uint8_t characters_into_escape_sequence = 0;
-	//uint8_t press_sequence = 0; //If the joystick has been pressed and is being held down
+	game_over = 0;
+	paused = 0;
 	
-	// Record the last time a block was dropped as the current time -
-	// this ensures we don't drop a block immediately.
-	last_drop_time = get_clock_ticks();
-	//uint8_t in_loop = 0; 
-	if (PIND & (1 << PIND6)) {
-		//Mute
-	} else {
-			clear_sound();
-			_delay_ms(200);
-			rotate_sound();
-			_delay_ms(200);
-			init_timer2();
+	// Button pushes, serial input and joystick movements are all turned
+	// into game actions and placed on the input event queue by their
+	// interrupt handlers while we're playing.
+	input_set_enabled(1);
+	if(replaying) {
+		record_replay_start();
 	}
 	set_is_running();
-	// We play the game forever. If the game is over, we will break out of
-	// this loop. The loop checks for events (button pushes, serial input etc.)
-	// and on a regular basis will drop the falling block down by one row.
-	while(1) { 
-		if (get_value(0) > 900 || get_value(0) < 200 || get_value(1) > 900 || get_value(1) < 200 ) {
-			press_sequence = 1; 
-		} else {
-			press_sequence = 0; 
-		}
+	show_seven_seg_value();
+	seven_seg_enable(1);
 	
-		show_score_to_terminal();
-		// Check for input - which could be a button push or serial input.
-		// Serial input may be part of an escape sequence, e.g. ESC [ D
-		// is a left cursor key press. We will be processing each character
-		// independently and can't do anything until we get the third character.
-		// At most one of the following three variables will be set to a value 
-		// other than -1 if input is available.
-		// (We don't initalise button to -1 since button_pushed() will return -1
-		// if no button pushes are waiting to be returned.)
-		// 
-		//pushes take priority over serial input. If there are both then
-		// we'll retrieve the serial input the next time through this loop 
-		serial_input = -1;
-		escape_sequence_char = -1;
-		button = button_pushed();
-		
-		
-		if(button == -1) {
-			// No push button was pushed, see if there is any serial input
-			if(serial_input_available()) {
-				// Serial data was available - read the data from standard input
-				serial_input = fgetc(stdin);
-				// Check if the character is part of an escape sequence
-				if(characters_into_escape_sequence == 0 && serial_input == ESCAPE_CHAR) {
-					// We've hit the first character in an escape sequence (escape)
-					characters_into_escape_sequence++;
-					serial_input = -1; // Don't further process this character
-				} else if(characters_into_escape_sequence == 1 && serial_input == '[') {
-					// We've hit the second character in an escape sequence
-					characters_into_escape_sequence++;
-					serial_input = -1; // Don't further process this character
-				} else if(characters_into_escape_sequence == 2) {
-					// Third (and last) character in the escape sequence
-					escape_sequence_char = serial_input;
-					serial_input = -1;  // Don't further process this character - we
-										// deal with it as part of the escape sequence
-					characters_into_escape_sequence = 0;
-				} else {
-					// Character was not part of an escape sequence (or we received
-					// an invalid second character in the sequence). We'll process 
-					// the data in the serial_input variable.
-					characters_into_escape_sequence = 0;
-				}
-			}
+	// Set up the tasks which make up the game. Input is handled every
+	// millisecond. Gravity drops are timed by timer 1 at the interval for
+	// the number of rows cleared (starting a full interval from now, so
+	// we don't drop a block immediately) and the gravity task runs when
+	// one is due - except in a replay, where gravity drops are part of 
+	// the recording. When the computer is playing, it chooses where each 
+	// block goes in one run of its task and then takes an action each 
+	// time its task runs after that.
+	scheduler_clear();
+	add_task(input_task, PSTR("input"), 1, 5);
+	gravity_task_id = -1;
+	if(!replaying) {
+		gravity_task_id = add_task(gravity_task, PSTR("gravity"), 
+				0, 5);
+		scheduler_set_trigger_flag(gravity_task_id, &gravity_drop_pending);
+		start_gravity_timer(get_drop_interval(&game));
+	}
+	if(autoplaying) {
+		autoplay_choice_due = 1;
+		add_task(autoplay_task, PSTR("autoplay"), 
+				AUTOPLAY_ACTION_INTERVAL, 5);
+	}
+	scheduler_trigger(add_task(display_task, PSTR("display"), 
+			2, 10));
+	add_task(status_task, PSTR("status"), 100, 50);
+	play_sound_effect(SOUND_START);
+}
+
+/*
+ * The game is over. Show the final state of the board and move on to 
+ * name entry if the player has a new high score (replayed scores and 
+ * the computer's scores don't go on the high score table), or the game
+ * over screen otherwise.
+ */
+static void end_game(void) {
+	game_over = 1;
+	stop_gravity_timer();
+	display_task();
+	input_set_enabled(0);
+	play_sound_effect(SOUND_GAME_OVER);
+	
+	high_score_position = -1;
+	if(!replaying && !autoplaying) {
+		record_end(get_score(&game));
+		placement_log_end(get_score(&game));
+		snapshot_clear();
+		high_score_position = leaderboard_position(get_score(&game));
+	}
+	next_state = (high_score_position >= 0) ? STATE_NAME_ENTRY :
+			STATE_GAME_OVER;
+}
+
+/*
+ * Called by the game when a block is fixed to the board (except in a
+ * replay).
+ */
+static void block_locked(const FallingBlock* block, uint8_t dropped_straight) {
+	placement_log_add(block->blocknum, block->rotation, block->column, 
+			block->row, dropped_straight);
+	snapshot_due = 1;
+}
+
+/*
+ * Called by the game when a block is fixed to the board while the 
+ * computer is playing. A place for the next block is chosen the next 
+ * time the autoplay task runs.
+ */
+static void autoplay_block_locked(const FallingBlock* block, 
+		uint8_t dropped_straight) {
+	(void)block;
+	(void)dropped_straight;
+	autoplay_choice_due = 1;
+}
+
+/*
+ * Save a snapshot of the game so it can be carried on after a reset. 
+ * This is skipped if the EEPROM queue doesn't have room for a whole 
+ * snapshot as well as the most that can be queued before the next one 
+ * (EEPROM_BYTES_AFTER_SNAPSHOT), so nothing has to wait for the queue.
+ * The next block's snapshot then writes all the changes since the last
+ * one saved.
+ */
+static void save_snapshot(void) {
+	if(eeprom_queue_space() < SNAPSHOT_SIZE + EEPROM_BYTES_AFTER_SNAPSHOT) {
+		return;
+	}
+	GameSnapshot snapshot;
+	save_game_snapshot(&game, &snapshot);
+	snapshot_save(&snapshot);
+}
+
+/*
+ * Handle every input event which has arrived since we last checked, in
+ * the order they arrived. In a replay, the recorded actions are first
+ * posted to the input event queue as they fall due.
+ */
+static void input_task(void) {
+	InputEvent event;
+	
+	if(game_over) {
+		return;
+	}
+	if(replaying && !paused) {
+		record_replay_poll();
+	}
+	while(!game_over && input_get_event(&event)) {
+		if(replaying && event.source != INPUT_SOURCE_REPLAY && 
+				event.action != INPUT_PAUSE) {
+			continue;	// Live input is ignored during a replay
 		}
-		
-		// Process the input
-		uint32_t current_clock = get_clock_ticks(); 
-		if(button==3 || escape_sequence_char=='D' || ((adc_value = get_value(0))) < 200) {
-			//get the current clock   | current_clock = get_clock_ticks();
-			//check if it was the ADC | if (adc_value  < 200)
-			//wait 300ms              | while (get_clock_ticks() < current_clock + 300) {}
-			//then move left
-			current_clock = get_clock_ticks(); 
-			if ((adc_value < 200) && press_sequence == 0) {
-				(void)attempt_move(MOVE_LEFT); 
-				while (get_clock_ticks() < current_clock + 300) {
-					//Do Nothing
-				}
-			} else if ((adc_value < 200) && press_sequence == 1){
-				current_clock = get_clock_ticks(); 
-				(void)attempt_move(MOVE_LEFT);
-				while (get_clock_ticks() < current_clock + 100) {
-					//Do Nothing
-				}
-			} else { //Don't delay if not joystick
-				(void)attempt_move(MOVE_LEFT);
-			}
-		} else if(button==0 || escape_sequence_char=='C' || ((adc_value = get_value(0))) > 900) {
-			/*
-			uint32_t current_clock = get_clock_ticks();
-			if (adc_value > 900) {
-				(void)attempt_move(MOVE_RIGHT);
-				while (get_clock_ticks() < current_clock + 300 ) {
-					//Do Nothing
-				}
-				} else { //Don't delay if not joystick
-				(void)attempt_move(MOVE_RIGHT);
-			}
-			*/
-			//___________________________________________________________________
-			current_clock = get_clock_ticks();
-			if ((adc_value > 900) && press_sequence == 0) {
-				(void)attempt_move(MOVE_RIGHT);
-				while (get_clock_ticks() < current_clock + 300) {
-					//Do Nothing
-				}
-				} else if ((adc_value > 900) && press_sequence == 1){
-				current_clock = get_clock_ticks();
-				(void)attempt_move(MOVE_RIGHT);
-				while (get_clock_ticks() < current_clock + 100) {
-					//Do Nothing
-				}
-				} else { //Don't delay if not joystick
-				(void)attempt_move(MOVE_RIGHT);
-			}
-			//____________________________________________________________________
-			
-		} else if (button==2 || escape_sequence_char == 'A' || ((adc_value = get_value(1))) > 900) {
-			// Attempt to rotate
-			//(void)attempt_rotation();
-			
-			/*uint32_t current_clock = get_clock_ticks();
-			if (adc_value > 900) {
-				(void)attempt_rotation();
-				while (get_clock_ticks() < current_clock + 300) {
-					//Do Nothing
-				}
-				} else { //Don't delay if not joystick
-				(void)attempt_rotation();
-			}*/
-			
-			if (PIND & (1 << PIND6)) {
-			} else {
-				rotate_sound();
-			}
-			
-			current_clock = get_clock_ticks();
-			if ((adc_value > 900) && press_sequence == 0) {
-				(void)attempt_rotation();
-				while (get_clock_ticks() < current_clock + 300) {
-					//Do Nothing
-				}
-				} else if ((adc_value > 900) && press_sequence == 1){
-				current_clock = get_clock_ticks();
-				(void)attempt_rotation();
-				while (get_clock_ticks() < current_clock + 100) {
-					//Do Nothing
-				}
-				} else { //Don't delay if not joystick
-				(void)attempt_rotation();
-			}
-			
-		} else if (button == 1 || serial_input == ' ') {
-				if (PIND & (1 << PIND6)) {
-					} else {
-					init_timer2();
-				} 	
-			while(attempt_drop_block_one_row());
-			
-			
-		} else if (escape_sequence_char == 'B' || ((adc_value = get_value(1)) < 100)) {
-			/*// Attempt to drop block
-			//while(attempt_drop_block_one_row()); 
-			if(!attempt_drop_block_one_row()) {
-				// Drop failed - fix block to board and add new block
-				if(!fix_block_to_board_and_add_new_block()) {
-					break;	// GAME OVER
-				}
-			} 
-			last_drop_time = get_clock_ticks();*/
-			
-			//_________________________________________
-			current_clock = get_clock_ticks();
-			if ((adc_value < 100) && press_sequence == 0) {
-				if(!attempt_drop_block_one_row()) {
-					// Drop failed - fix block to board and add new block
-					if(!fix_block_to_board_and_add_new_block()) {
-						break;	// GAME OVER
-					}
-				}
-				last_drop_time = get_clock_ticks();
-				while (get_clock_ticks() < current_clock + 300) {
-					//Do Nothing
-				}
-				} else if ((adc_value < 100) && press_sequence == 1){
-				current_clock = get_clock_ticks();
-				if(!attempt_drop_block_one_row()) {
-					// Drop failed - fix block to board and add new block
-					if(!fix_block_to_board_and_add_new_block()) {
-						break;	// GAME OVER
-					}
-				}
-				last_drop_time = get_clock_ticks();
-				while (get_clock_ticks() < current_clock + 100) {
-					//Do Nothing
-				}
-				} else { //Don't delay if not joystick
-				if(!attempt_drop_block_one_row()) {
-					// Drop failed - fix block to board and add new block
-					if(!fix_block_to_board_and_add_new_block()) {
-						break;	// GAME OVER
-					}
-				}
-				last_drop_time = get_clock_ticks();
-			}
-			
-			
-			
-			
-			
-			
-			
-			//_________________________________________
-			
-			
-			
-			
-		} else if(serial_input == 'p' || serial_input == 'P') { 
-			empty_button_queue();
-			///my implementation///
-			uint32_t time_to_wait;
-			uint32_t current_pause = get_clock_ticks(); 
-			while(1) {
-				time_to_wait = get_clock_ticks() - last_drop_time; 
-				move_cursor(10, 14);
-				printf_P(PSTR("%s"), get_score());
-				serial_input = fgetc(stdin); 
-				if(serial_input == 'p' || serial_input == 'P') {
-					break;
-				}
-				
-			}
-			current_pause = get_clock_ticks(); 
-			while(get_clock_ticks() < current_pause + time_to_wait){
-				//Do Nothing
+		if(autoplaying) {
+			// Any input stops the computer playing and goes back to
+			// the splash screen
+			if(event.action != INPUT_CALIBRATE) {
+				game_over = 1;
+				stop_gravity_timer();
+				input_set_enabled(0);
+				next_state = STATE_SPLASH;
 			}
-			//clear_terminal();
-			empty_button_queue();
-		} 
-		// else - invalid input or we're part way through an escape sequence -
-		// do nothing
-		// Check for timer related events here
-		if(get_clock_ticks() >= last_drop_time + currentSpeed) {
-			//accelerate when a row is cleared
-			if (currentSpeed < 200) {
-				currentSpeed = currentSpeed; 
-			} else {
-				currentSpeed = get_acceleration();//currentSpeed * get_acceleration(); 
- 
-				
+			continue;
+		}
+		if(paused) {
+			if(event.action == INPUT_PAUSE) {
+				resume_game();
 			}
-			// 600ms (0.6 second) has passed since the last time we dropped
-			// a block, so drop it now.
-			if(!attempt_drop_block_one_row()) {
-				// Drop failed - fix block to board and add new block
-				if(!fix_block_to_board_and_add_new_block()) {
-					break;	// GAME OVER
+			continue;	// Any other input is discarded while paused
+		}
+		switch(event.action) {
+			case INPUT_PAUSE:
+				pause_game();
+				break;
+			case INPUT_CALIBRATE:
+				// Joystick is at rest - record its centre position
+				joystick_calibrate_centre();
+				break;
+			default:
+				if(!handle_game_action(event.action)) {
+					end_game();
 				}
-			}
-			last_drop_time = get_clock_ticks();
+				break;
+		}
+	}
+	if(replaying && !paused && !game_over && record_replay_finished()) {
+		// Ran out of recorded actions without the game ending
+		end_game();
+	}
+}
+
+/*
+ * Drop the falling block one row and speed up if rows have been cleared.
+ */
+static void gravity_task(void) {
+	if(paused || game_over) {
+		return;
+	}
+	gravity_drop_handled();
+	if(!handle_game_action(INPUT_GRAVITY_DROP)) {
+		end_game();
+		return;
+	}
+	// Speed up as rows are cleared
+	set_gravity_interval(get_drop_interval(&game));
+}
+
+/*
+ * Let the computer take its next action, or choose where a new block
+ * is to go.
+ */
+static void autoplay_task(void) {
+	if(paused || game_over) {
+		return;
+	}
+	if(autoplay_choice_due) {
+		autoplay_choice_due = 0;
+		(void)autoplay_choose(&game, &autoplay_move);
+		return;
+	}
+	if(!handle_game_action(autoplay_next_action(&game, &autoplay_move))) {
+		end_game();
+	}
+}
+
+/*
+ * Send any changed rows of the board to the LED matrix, and the value
+ * shown on the seven segment display if it has changed.
+ */
+static void display_task(void) {
+	flush_display(&game);
+	note_first_frame();
+	show_seven_seg_value();
+}
+
+/*
+ * Record the time the first frame was sent to the LED matrix after 
+ * start up (if it hasn't already been recorded).
+ */
+static void note_first_frame(void) {
+	if(!first_frame_time) {
+		first_frame_time = get_clock_us();
+	}
+}
+
+/*
+ * Print the time from start up (timer 0 being started) to the first frame.
+ */
+static void print_boot_time(void) {
+	printf_P(PSTR("\nFirst frame %lu.%03lu ms after start up"), 
+			(unsigned long)(first_frame_time / 1000), 
+			(unsigned long)(first_frame_time % 1000));
+}
+
+/*
+ * Show the chosen value on the seven segment display. The score and 
+ * rows cleared are kept in BCD, so their digits are shown as they are 
+ * (the display shows the lowest digits).
+ */
+static void show_seven_seg_value(void) {
+	switch(seven_seg_shows) {
+		case SHOW_SCORE:
+			seven_seg_show_bcd(get_score_bcd(&game));
+			break;
+		case SHOW_LEVEL:
+			seven_seg_show_number(get_speed_level(&game) + 1);
+			break;
+		case SHOW_SPEED:
+			// Gravity drops per 10 seconds
+			seven_seg_show_number(10000 / get_drop_interval(&game));
+			break;
+		default:
+			seven_seg_show_bcd(get_cleared_count_bcd(&game));
+			break;
+	}
+}
+
+/*
+ * Update the score on the terminal.
+ */
+static void status_task(void) {
+	if(!paused && !game_over) {
+		show_score_to_terminal(&game);
+	}
+}
+
+uint8_t handle_game_action(uint8_t action) {
+	// Record the action (unless we're replaying it or the computer is 
+	// playing) and apply it
+	if(!replaying && !autoplaying) {
+		record_action(action);
+	}
+	uint8_t still_playing = apply_game_action(&game, action);
+	if(snapshot_due) {
+		// A block has been fixed to the board and the next one added
+		snapshot_due = 0;
+		if(still_playing) {
+			save_snapshot();
 		}
 	}
-	// If we get here the game is over. 
+	if(action == INPUT_SOFT_DROP && gravity_task_id >= 0) {
+		// The block has just dropped - wait a full interval for the next
+		// gravity drop
+		restart_gravity_interval();
+	}
+	return still_playing;
 }
 
+void pause_game(void) {
+	paused = 1;
+	pause_start = get_clock_ticks();
+	if(gravity_task_id >= 0) {
+		pause_gravity_timer();
+	}
+	move_cursor(10, 14);
+	printf_P(PSTR("PAUSED"));
+}
+
+void resume_game(void) {
+	// Don't count the time we were paused towards the next gravity drop
+	// or the timing of the replay
+	uint32_t paused_for = get_clock_ticks() - pause_start;
+	if(gravity_task_id >= 0) {
+		resume_gravity_timer();
+	}
+	if(replaying) {
+		record_replay_delay(paused_for);
+	}
+	move_cursor(10, 14);
+	clear_to_end_of_line();
+	paused = 0;
+}
+
+
+/*
+ * Ask for the player's name for the high score table. Input arrives
+ * through name_entry_task().
+ */
+static void start_name_entry(void) {
+	clear_terminal();
+	move_cursor(10,14);
+	printf_P(PSTR("GAME OVER"));
+	move_cursor(10,16);
+	printf_P(PSTR("Score: %10lu"), (unsigned long)get_score(&game));
+	move_cursor(10,18);
+	printf_P(PSTR("You got a high score! Enter Your Name: "));
+	clear_serial_input_buffer();
+	name_length = 0;
+	name_entry_task_id = add_task(name_entry_task, PSTR("name"), 
+			10, 10);
+}
+
+/*
+ * Take the letters of the player's name as they are typed. If no name
+ * has been typed by the timeout, the rest of it is filled with dashes.
+ * Once we have a name, the high score is saved.
+ */
+static void name_entry_task(void) {
+	while(name_length < 2 && serial_input_available()) {
+		char c = fgetc(stdin);
+		if((c < 65) || (c > 122)) {
+			continue;
+		}
+		name[name_length++] = c;
+		printf_P(PSTR("%c"), c);
+	}
+	if(name_length < 2 && 
+			get_clock_ticks() - state_entered >= NAME_ENTRY_TIMEOUT) {
+		while(name_length < 2) {
+			name[name_length++] = '-';
+		}
+	}
+	if(name_length == 2) {
+		leaderboard_add(get_score(&game), name);
+		scheduler_set_period(name_entry_task_id, 0);
+		next_state = STATE_GAME_OVER;
+	}
+}
 
 void handle_game_over() {
 	clear_terminal();
@@ -431,27 +732,78 @@ void handle_game_over() {
 	move_cursor(10,15);
 	printf_P(PSTR("Press a button to start again"));
 	move_cursor(10,16);
-	printf_P(PSTR("\nScore: %10d"), get_score());
-	save_high_score_array();
+	printf_P(PSTR("\nScore: %10lu"), (unsigned long)get_score(&game));
+	if(replaying) {
+		// Replayed scores don't go on the high score table
+		printf_P(PSTR("\nReplay of game with score %lu"), 
+				(unsigned long)record_score());
+	} else if(autoplaying) {
+		printf_P(PSTR("\nPlayed by the computer"));
+	}
 	empty_button_queue();
-	_delay_ms(10); 
 	move_cursor(10,14);
 	set_display_attribute(FG_CYAN);
 	printf_P(PSTR("\n\n")); 
-	display_high_score();
-	
-	
-	
-	
-	
-	//We now have the users name stored in an array - this needs to be written to EEPROM in the suitable position
-	//store_name_in_array();
-	
+	leaderboard_display();
 	
 	normal_display_mode();
-	while(button_pushed() == -1) {
-		; // wait until a button has been pushed
+	printf_P(PSTR("\nd: dump recording  r: replay last game  s: task stats"));
+	printf_P(PSTR("\nl: dump placement log  a: watch the computer play"));
+	printf_P(PSTR("\nv: change seven segment value  b: change brightness"));
+	printf_P(PSTR("\nc: stream recordings to serial "));
+	printf_P(record_streaming() ? PSTR("(on)") : PSTR("(off)"));
+	clear_serial_input_buffer();
+	replaying = 0;
+	autoplaying = 0;
+	add_task(game_over_task, PSTR("game over"), 10, 10);
+}
+
+/*
+ * Start a new game when a button is pushed, or a replay of the last 
+ * game if requested, and handle the other game over screen commands.
+ * If nothing happens for a while, go back to the splash screen.
+ */
+static void game_over_task(void) {
+	if(button_pushed() != -1) {
+		next_state = STATE_PLAYING;
+		return;
+	}
+	if(get_clock_ticks() - state_entered >= GAME_OVER_TIMEOUT) {
+		next_state = STATE_SPLASH;
+		return;
+	}
+	if(!serial_input_available()) {
+		return;
 	}
-	//reset the cleared rows counter to 0
-	set_cleared_count(0); 
-}
\ No newline at end of file
+	char serial_input = fgetc(stdin);
+	if(serial_input == 'd' || serial_input == 'D') {
+		record_dump();
+	} else if(serial_input == 'l' || serial_input == 'L') {
+		placement_log_dump();
+	} else if(serial_input == 's' || serial_input == 'S') {
+		scheduler_print_stats();
+		print_gravity_timer_stats();
+		print_boot_time();
+		printf_P(PSTR("\nEEPROM bytes waiting to be written: %u"), 
+				eeprom_queue_pending());
+	} else if(serial_input == 'v' || serial_input == 'V') {
+		seven_seg_shows = (seven_seg_shows + 1) % NUM_SHOW_OPTIONS;
+		show_seven_seg_value();
+	} else if(serial_input == 'b' || serial_input == 'B') {
+		// Cycle through full, half and low brightness
+		seven_seg_brightness = (seven_seg_brightness == 100) ? 50 :
+				(seven_seg_brightness == 50) ? 15 : 100;
+		seven_seg_set_duty(seven_seg_brightness);
+	} else if((serial_input == 'r' || serial_input == 'R') && 
+			record_complete()) {
+		replaying = 1;
+		next_state = STATE_PLAYING;
+	} else if(serial_input == 'c' || serial_input == 'C') {
+		record_set_streaming(!record_streaming());
+		printf_P(record_streaming() ? PSTR("\nStreaming recordings on") :
+				PSTR("\nStreaming recordings off"));
+	} else if(serial_input == 'a' || serial_input == 'A') {
+		autoplaying = 1;
+		next_state = STATE_PLAYING;
+	}
+}
@@ -0,0 +1,240 @@
+/*
+ * record.c
+ *
+ * Author: Elliot Randall
+ *
+ * See record.h for details.
+ */
+
+#include <avr/pgmspace.h>
+#include <stdio.h>
+
+#include "record.h"
+#include "input.h"
+#include "timer0.h"
+
+/* The ring buffer of recorded actions. Each entry is an action, the 
+ * number of gravity drops since the previous entry (in the top 5 bits
+ * of the action byte) and the number of ticks since the previous entry
+ * (or the start of the game for the first entry). Intervals longer than
+ * 65535 ticks are stored as 65535. next_entry is where the next entry 
+ * will be stored and entries_recorded counts all entries recorded 
+ * (saturating), so the buffer has wrapped around if this is more than
+ * RECORD_SIZE.
+ */
+#define RECORD_SIZE 128
+static uint8_t recorded_action[RECORD_SIZE];
+static uint16_t recorded_ticks[RECORD_SIZE];
+static uint8_t next_entry;
+static uint16_t entries_recorded;
+
+#define ACTION_BITS 3
+#define ACTION_MASK ((1 << ACTION_BITS) - 1)
+#define MAX_DROPS_BEFORE 31
+#define ENTRY(action, drops) ((action) | ((drops) << ACTION_BITS))
+#define ENTRY_ACTION(entry) ((entry) & ACTION_MASK)
+#define ENTRY_DROPS(entry) ((entry) >> ACTION_BITS)
+
+/* Gravity drops since the last entry, and when the last of them was */
+static uint8_t pending_drops;
+static uint32_t last_drop_time;
+
+static uint32_t seed;
+static uint32_t final_score;
+static uint32_t last_entry_time;
+
+/* Whether actions are written to the serial port as they happen, and
+ * the time the last one was
+ */
+static uint8_t streaming = RECORD_STREAM_TO_SERIAL;
+static uint32_t last_streamed_time;
+
+/* Replay state - the index of the next entry to post, the number of its
+ * gravity drops posted so far and the clock tick value from which its
+ * interval is counted.
+ */
+static uint16_t replay_entry;
+static uint8_t replay_drops_posted;
+static uint32_t replay_entry_start;
+
+static void add_entry(uint8_t action, uint32_t time);
+static uint16_t drop_offset(uint16_t ticks, uint8_t drop, uint8_t drops);
+
+void record_start(uint32_t game_seed) {
+	seed = game_seed;
+	final_score = 0;
+	next_entry = 0;
+	entries_recorded = 0;
+	pending_drops = 0;
+	last_entry_time = get_clock_ticks();
+	last_streamed_time = last_entry_time;
+	if(streaming) {
+		printf_P(PSTR("\x1b_S%lx\x1b\\"), (unsigned long)seed);
+	}
+}
+
+void record_start_resumed(void) {
+	record_start(0);
+	entries_recorded = UINT16_MAX;	// Treat as missing the start
+}
+
+void record_action(uint8_t action) {
+	uint32_t now = get_clock_ticks();
+	if(streaming) {
+		uint32_t ticks = now - last_streamed_time;
+		last_streamed_time = now;
+		printf_P(PSTR("\x1b_R%u,%u\x1b\\"), action, 
+				(uint16_t)(ticks > UINT16_MAX ? UINT16_MAX : ticks));
+	}
+	
+	// Gravity drops are counted towards the next entry, unless there 
+	// have been too many since the last
+	if(action == INPUT_GRAVITY_DROP && pending_drops < MAX_DROPS_BEFORE) {
+		pending_drops++;
+		last_drop_time = now;
+		return;
+	}
+	add_entry(action, now);
+}
+
+void record_end(uint32_t score) {
+	// Gravity drops at the end of the game (which may have ended it)
+	// aren't followed by an action, so the last becomes an entry itself
+	if(pending_drops) {
+		pending_drops--;
+		add_entry(INPUT_GRAVITY_DROP, last_drop_time);
+	}
+	final_score = score;
+	if(streaming) {
+		printf_P(PSTR("\x1b_E%lu\x1b\\"), (unsigned long)final_score);
+	}
+}
+
+void record_set_streaming(uint8_t enable) {
+	streaming = enable;
+}
+
+uint8_t record_streaming(void) {
+	return streaming;
+}
+
+uint32_t record_seed(void) {
+	return seed;
+}
+
+uint32_t record_score(void) {
+	return final_score;
+}
+
+uint8_t record_complete(void) {
+	return entries_recorded <= RECORD_SIZE;
+}
+
+void record_dump(void) {
+	uint8_t entry;
+	uint16_t num_entries;
+	if(record_complete()) {
+		entry = 0;
+		num_entries = entries_recorded;
+		printf_P(PSTR("\x1b_S%lx\x1b\\"), (unsigned long)seed);
+	} else {
+		// The oldest surviving entry is the one about to be overwritten
+		entry = next_entry;
+		num_entries = RECORD_SIZE;
+		printf_P(PSTR("\x1b_T%lx\x1b\\"), (unsigned long)seed);
+	}
+	// Each gravity drop is written out as an action of its own, at the
+	// time it is replayed
+	for(uint16_t i = 0; i < num_entries; i++) {
+		uint8_t drops = ENTRY_DROPS(recorded_action[entry]);
+		uint16_t ticks = recorded_ticks[entry];
+		uint16_t offset = 0;
+		for(uint8_t drop = 1; drop <= drops; drop++) {
+			uint16_t next_offset = drop_offset(ticks, drop, drops);
+			printf_P(PSTR("\x1b_R%u,%u\x1b\\"), INPUT_GRAVITY_DROP, 
+					next_offset - offset);
+			offset = next_offset;
+		}
+		printf_P(PSTR("\x1b_R%u,%u\x1b\\"), 
+				ENTRY_ACTION(recorded_action[entry]), ticks - offset);
+		entry = (entry + 1) % RECORD_SIZE;
+	}
+	printf_P(PSTR("\x1b_E%lu\x1b\\"), (unsigned long)final_score);
+}
+
+void record_replay_start(void) {
+	replay_entry = 0;
+	replay_drops_posted = 0;
+	replay_entry_start = get_clock_ticks();
+}
+
+void record_replay_poll(void) {
+	uint32_t now = get_clock_ticks();
+	// Post each action that is due - first the gravity drops before an 
+	// entry's action, spread evenly over its interval, then the action.
+	// If the input queue is full we stop and try again next time so no
+	// actions are lost.
+	while(!record_replay_finished()) {
+		uint8_t drops = ENTRY_DROPS(recorded_action[replay_entry]);
+		uint16_t ticks = recorded_ticks[replay_entry];
+		uint8_t action;
+		uint32_t due_time;
+		if(replay_drops_posted < drops) {
+			action = INPUT_GRAVITY_DROP;
+			due_time = replay_entry_start + 
+					drop_offset(ticks, replay_drops_posted + 1, drops);
+		} else {
+			action = ENTRY_ACTION(recorded_action[replay_entry]);
+			due_time = replay_entry_start + ticks;
+		}
+		if(!ticks_reached(now, due_time) || 
+				!input_post_event(INPUT_SOURCE_REPLAY, action)) {
+			return;
+		}
+		if(replay_drops_posted < drops) {
+			replay_drops_posted++;
+		} else {
+			replay_entry_start += ticks;
+			replay_drops_posted = 0;
+			replay_entry++;
+		}
+	}
+}
+
+void record_replay_delay(uint32_t ticks) {
+	replay_entry_start += ticks;
+}
+
+uint8_t record_replay_finished(void) {
+	return replay_entry >= entries_recorded;
+}
+
+/*
+ * Add an entry for the given action at the given time, taking in the
+ * gravity drops since the last entry.
+ */
+static void add_entry(uint8_t action, uint32_t time) {
+	uint32_t ticks = time - last_entry_time;
+	if(ticks > UINT16_MAX) {
+		ticks = UINT16_MAX;
+	}
+	last_entry_time = time;
+	
+	recorded_action[next_entry] = ENTRY(action, pending_drops);
+	recorded_ticks[next_entry] = ticks;
+	pending_drops = 0;
+	next_entry = (next_entry + 1) % RECORD_SIZE;
+	if(entries_recorded != UINT16_MAX) {
+		entries_recorded++;
+	}
+}
+
+/*
+ * Return when the given gravity drop (1 to drops) of an entry is 
+ * replayed, in ticks from the start of its interval. Only the order of
+ * the drops and actions matters to the game, so the drops are just 
+ * spread evenly before the action.
+ */
+static uint16_t drop_offset(uint16_t ticks, uint8_t drop, uint8_t drops) {
+	return (uint32_t)ticks * drop / (drops + 1);
+}
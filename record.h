@@ -0,0 +1,104 @@
+/*
+ * record.h
+ *
+ * Author: Elliot Randall
+ *
+ * Records every game action (see input.h) applied during a game, with
+ * the number of clock ticks since the previous action, along with the
+ * seed given to the block generator. The game engine is deterministic 
+ * given the seed and the sequence of actions, so this is enough to 
+ * replay the game - either on the device, through the same code as 
+ * live play, or on the host (see host/replay.c).
+ *
+ * Actions are kept in a RAM ring buffer of 128 entries (384 bytes). 
+ * Gravity drops aren't given entries of their own - each entry holds a
+ * player's action along with the number of gravity drops since the last
+ * entry (up to 31, after which a gravity drop takes an entry). The game
+ * only depends on the order of the drops and actions, so on replay the
+ * drops are spread evenly over the time before the action. A player 
+ * takes about 4 to 6 actions per block, so the buffer holds roughly the
+ * first 25 blocks - a couple of minutes of play at the starting speed.
+ * If a game has more entries than the buffer holds, the oldest are 
+ * overwritten and the recording can no longer be replayed from the 
+ * start. Longer games can be captured by streaming, where each action
+ * (including every gravity drop) is also written to the serial port as
+ * it happens. Streaming starts on if RECORD_STREAM_TO_SERIAL is 1 and 
+ * can be turned on and off with record_set_streaming().
+ *
+ * Recordings are written to the serial port as Application Program 
+ * Command strings (ESC _ ... ESC \), which terminals do not display, so
+ * they can be mixed in with the normal terminal output:
+ *     ESC _ S<seed in hex> ESC \			start of a game
+ *     ESC _ R<action>,<ticks> ESC \		an action
+ *     ESC _ E<score> ESC \					end of the game
+ * A dump of a recording which has lost its oldest actions starts with
+ * T instead of S.
+ */
+
+#ifndef RECORD_H_
+#define RECORD_H_
+
+#include <stdint.h>
+
+#define RECORD_STREAM_TO_SERIAL 0
+
+/* Start a new recording for a game played with the given block
+ * generator seed.
+ */
+void record_start(uint32_t seed);
+
+/* Start a new recording for a game carried on from a snapshot (see 
+ * snapshot.h). We don't know how the game started, so the recording 
+ * can't be replayed.
+ */
+void record_start_resumed(void);
+
+/* Record a game action. 
+ */
+void record_action(uint8_t action);
+
+/* Finish the recording, noting the final score.
+ */
+void record_end(uint32_t score);
+
+/* Turn streaming of recordings to the serial port on (non-zero) or off,
+ * from the next game, and return whether it is on.
+ */
+void record_set_streaming(uint8_t enable);
+uint8_t record_streaming(void);
+
+/* Return the seed and final score of the recording.
+ */
+uint32_t record_seed(void);
+uint32_t record_score(void);
+
+/* Return 1 if the recording holds the whole game (i.e. can be replayed),
+ * 0 otherwise.
+ */
+uint8_t record_complete(void);
+
+/* Write the recording to the serial port.
+ */
+void record_dump(void);
+
+/* Start replaying the recording. Actions will be posted to the input 
+ * event queue (with source INPUT_SOURCE_REPLAY) by record_replay_poll()
+ * at the same intervals they were recorded at.
+ */
+void record_replay_start(void);
+
+/* Post any recorded actions that are now due to the input event queue.
+ * Should be called frequently while replaying.
+ */
+void record_replay_poll(void);
+
+/* Delay the rest of the replay by the given number of ticks (e.g. 
+ * because the game was paused).
+ */
+void record_replay_delay(uint32_t ticks);
+
+/* Return 1 if all recorded actions have been posted, 0 otherwise.
+ */
+uint8_t record_replay_finished(void);
+
+#endif /* RECORD_H_ */
@@ -0,0 +1,154 @@
+/*
+ * scheduler.c
+ *
+ * Author: Elliot Randall
+ *
+ * See scheduler.h for details.
+ */
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <avr/pgmspace.h>
+#include <stdio.h>
+
+#include "scheduler.h"
+#include "timer0.h"
+
+typedef struct {
+	TaskFunction function;
+	const char* name;
+	uint16_t period;
+	uint16_t deadline;
+	uint32_t next_run;		// Clock tick value at which the task is due
+	uint8_t due;			// Set if the task is due (periodic or triggered)
+	volatile uint8_t* trigger_flag;	// If set, makes the task due
+	uint16_t run_count;
+	uint32_t worst_run_time;	// In microseconds
+	uint16_t missed_deadlines;
+} Task;
+
+static Task tasks[SCHEDULER_MAX_TASKS];
+static uint8_t num_tasks = 0;
+
+void scheduler_clear(void) {
+	num_tasks = 0;
+}
+
+int8_t scheduler_add_task(TaskFunction function, const char* name,
+		uint16_t period, uint16_t deadline) {
+	if(num_tasks >= SCHEDULER_MAX_TASKS) {
+		return -1;
+	}
+	Task* task = &tasks[num_tasks];
+	task->function = function;
+	task->name = name;
+	task->period = period;
+	task->deadline = deadline;
+	task->next_run = get_clock_ticks() + period;
+	task->due = 0;
+	task->trigger_flag = 0;
+	task->run_count = 0;
+	task->worst_run_time = 0;
+	task->missed_deadlines = 0;
+	return num_tasks++;
+}
+
+void scheduler_set_trigger_flag(int8_t task, volatile uint8_t* flag) {
+	tasks[task].trigger_flag = flag;
+}
+
+void scheduler_trigger(int8_t task) {
+	tasks[task].next_run = get_clock_ticks();
+	tasks[task].due = 1;
+}
+
+void scheduler_set_period(int8_t task, uint16_t period) {
+	tasks[task].period = period;
+}
+
+void scheduler_restart_period(int8_t task) {
+	tasks[task].next_run = get_clock_ticks() + tasks[task].period;
+}
+
+void scheduler_delay_task(int8_t task, uint32_t ticks) {
+	tasks[task].next_run += ticks;
+}
+
+void scheduler_run_pending(void) {
+	for(uint8_t i = 0; i < num_tasks; i++) {
+		Task* task = &tasks[i];
+		uint32_t now = get_clock_ticks();
+		
+		// Periodic tasks are due once their next run time is reached
+		if(task->period != 0 && ticks_reached(now, task->next_run)) {
+			task->due = 1;
+		}
+		
+		// Tasks with a trigger flag are due when the flag is set. We
+		// clear it with interrupts off so we can't miss it being set 
+		// again by an interrupt handler.
+		if(task->trigger_flag && *task->trigger_flag) {
+			uint8_t interrupts_were_on = bit_is_set(SREG, SREG_I);
+			cli();
+			*task->trigger_flag = 0;
+			if(interrupts_were_on) {
+				sei();
+			}
+			if(!task->due) {
+				task->due = 1;
+				task->next_run = now;
+			}
+		}
+		if(!task->due) {
+			continue;
+		}
+		
+		if(now - task->next_run > task->deadline) {
+			task->missed_deadlines++;
+		}
+		
+		// Timed in microseconds rather than with the 16 bit fine clock,
+		// which would wrap for tasks longer than about 524ms
+		task->due = 0;
+		uint32_t start = get_clock_us();
+		task->function();
+		uint32_t run_time = get_clock_us() - start;
+		
+		task->run_count++;
+		if(run_time > task->worst_run_time) {
+			task->worst_run_time = run_time;
+		}
+		
+		// Schedule the next run from when this one was due so that
+		// periodic tasks don't drift. If we have fallen more than a 
+		// period behind, we skip the missed runs.
+		if(task->period != 0) {
+			task->next_run += task->period;
+			if(ticks_reached(now, task->next_run)) {
+				task->next_run = now + task->period;
+			}
+		}
+	}
+}
+
+uint16_t scheduler_run_count(int8_t task) {
+	return tasks[task].run_count;
+}
+
+uint32_t scheduler_worst_run_time(int8_t task) {
+	return tasks[task].worst_run_time;
+}
+
+uint16_t scheduler_missed_deadlines(int8_t task) {
+	return tasks[task].missed_deadlines;
+}
+
+void scheduler_print_stats(void) {
+	printf_P(PSTR("\nTASK      RUNS  WORST(us)  MISSED\n"));
+	for(uint8_t i = 0; i < num_tasks; i++) {
+		printf_P(tasks[i].name);
+		printf_P(PSTR("\t%6u  %9lu  %6u\n"), scheduler_run_count(i), 
+				(unsigned long)scheduler_worst_run_time(i), 
+				scheduler_missed_deadlines(i));
+	}
+}
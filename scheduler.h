@@ -0,0 +1,78 @@
+/*
+ * scheduler.h
+ *
+ * Author: Elliot Randall
+ *
+ * A small cooperative scheduler driven by the timer0 clock tick (see
+ * timer0.h). Tasks are functions which run to completion. Each task 
+ * either runs periodically (every "period" ticks) or only when 
+ * triggered (period 0) - by a call to scheduler_trigger() or by a flag
+ * set in an interrupt handler. A task is late if it starts more than 
+ * "deadline" ticks after it became due. For each task we keep a count 
+ * of runs, the worst-case run time and the number of missed deadlines.
+ */
+
+#ifndef SCHEDULER_H_
+#define SCHEDULER_H_
+
+#include <stdint.h>
+
+/* The most tasks at once. The busiest states (see project.c) have 6 - 
+ * the game tasks kept for their statistics, plus name entry and game 
+ * over - so this leaves room for two more.
+ */
+#define SCHEDULER_MAX_TASKS 8
+
+typedef void (*TaskFunction)(void);
+
+/* Remove all tasks.
+ */
+void scheduler_clear(void);
+
+/* Add a task. name should be a string in program memory (PSTR) and is
+ * only used by scheduler_print_stats(). A periodic task first runs one
+ * period from now. Returns the task id, or -1 if there are already
+ * SCHEDULER_MAX_TASKS tasks.
+ */
+int8_t scheduler_add_task(TaskFunction function, const char* name,
+		uint16_t period, uint16_t deadline);
+
+/* Make the given task run whenever the given flag is set (e.g. by an
+ * interrupt handler). The flag is cleared when the task is made due.
+ */
+void scheduler_set_trigger_flag(int8_t task, volatile uint8_t* flag);
+
+/* Make the given task due now (whatever its period).
+ */
+void scheduler_trigger(int8_t task);
+
+/* Change the period of the given task. This takes effect after the 
+ * task next runs. A period of 0 means the task only runs when triggered.
+ */
+void scheduler_set_period(int8_t task, uint16_t period);
+
+/* Restart the period of the given task, i.e. it is next due one period
+ * from now.
+ */
+void scheduler_restart_period(int8_t task);
+
+/* Push the next run of the given task back by the given number of ticks.
+ */
+void scheduler_delay_task(int8_t task, uint32_t ticks);
+
+/* Run each task that is due, once, in the order the tasks were added.
+ * Should be called repeatedly from the main loop.
+ */
+void scheduler_run_pending(void);
+
+/* Statistics for the given task. Run times are in microseconds.
+ */
+uint16_t scheduler_run_count(int8_t task);
+uint32_t scheduler_worst_run_time(int8_t task);
+uint16_t scheduler_missed_deadlines(int8_t task);
+
+/* Print the statistics for all tasks to the terminal.
+ */
+void scheduler_print_stats(void);
+
+#endif /* SCHEDULER_H_ */
@@ -6,187 +6,97 @@
 
 #include "score.h"
 #include <avr/io.h>
-#include <avr/eeprom.h>
 #include "terminalio.h"
 #include <avr/pgmspace.h> // For PSTR
 #include <stdio.h>
 #include <stdlib.h>
 
-// Variable to keep track of the score. We declare it as static
-// to ensure that it is only visible within this module - other
-// modules should call the functions below to modify/access the
-// variable.
-static uint32_t score;
-uint16_t high_scores[5]; 
-char high_score_names[5][2]; 
-//static uint8_t number_of_scores = 5; 
+// The score is kept in the GameState (see game.h) - other modules 
+// should call the functions below to modify/access it.
 
-void init_score(void) {
-	score = 0;
+void init_score(GameState* game) {
+	game->score = 0;
 }
 
-void add_to_score(uint16_t value) {
-	score += value;
+void add_to_score(GameState* game, uint16_t value) {
+	game->score = bcd_add(game->score, value);
 }
 
-uint32_t get_score(void) {
-	return score;
+void set_score(GameState* game, uint32_t value) {
+	game->score = binary_to_bcd(value);
 }
 
-void show_score_to_terminal() {
-	move_cursor(20, 0);
-	hide_cursor();
-	printf_P(PSTR("Score: %10d"), get_score());
-	move_cursor(0, 20);
-} 
+uint32_t get_score(const GameState* game) {
+	return bcd_to_binary(game->score);
+}
 
+uint32_t get_score_bcd(const GameState* game) {
+	return game->score;
+}
 
-void save_high_score_array(void) {
-	uint8_t position = 20; 
-	for (uint8_t i = 0; i < 4; i++) {
-		if (score > high_scores[i] || high_scores[i] == 0b1111111111111111) {
-			position = i;  
-			break; 
-		}
+void show_score_to_terminal(const GameState* game) {
+	// Right align the score in 10 characters (as %10lu would), taking 
+	// the digits straight from the BCD score
+	char text[11];
+	uint32_t score = game->score;
+	uint8_t leading = 1;
+	text[0] = text[1] = ' ';
+	for(uint8_t i = 2; i < 10; i++) {
+		uint8_t digit = score >> 28;
+		score <<= 4;
+		leading = leading && digit == 0;
+		text[i] = leading ? ' ' : '0' + digit;
 	}
-	for (int j = 3; j >= position; j--) {
-		high_scores[j + 1] = high_scores[j]; 
+	if(leading) {
+		text[9] = '0';
 	}
+	text[10] = '\0';
 	
-	if (position != 20) {
-		high_scores[position] = score;
-		eeprom_write_word(( uint16_t *)0, high_scores[0]);
-		eeprom_write_word(( uint16_t *)2, high_scores[1]);
-		eeprom_write_word(( uint16_t *)4, high_scores[2]);
-		eeprom_write_word(( uint16_t *)6, high_scores[3]);
-		eeprom_write_word(( uint16_t *)8, high_scores[4]);
-		write_name_to_eeprom2(position); 
-	}
-	  
-}
-
-
-void display_high_score(void) {
-	move_cursor(0,0); 
-	printf_P(PSTR("HIGHSCORES\n"));
-	printf_P(PSTR("__________\n"));	
-	printf_P(PSTR("%c"), eeprom_read_word(( uint16_t *)100));
-	printf_P(PSTR("%c: "), eeprom_read_word(( uint16_t *)102));
-	printf_P(PSTR("%d\n"), eeprom_read_word(( uint16_t *)0));
-	
-	printf_P(PSTR("%c"), eeprom_read_word(( uint16_t *)104));
-	printf_P(PSTR("%c: "), eeprom_read_word(( uint16_t *)106));
-	printf_P(PSTR("%d\n"), eeprom_read_word(( uint16_t *)2));
-	
-	printf_P(PSTR("%c"), eeprom_read_word(( uint16_t *)108));
-	printf_P(PSTR("%c: "), eeprom_read_word(( uint16_t *)110));
-	printf_P(PSTR("%d\n"), eeprom_read_word(( uint16_t *)4));
-	
-	printf_P(PSTR("%c"), eeprom_read_word(( uint16_t *)112));
-	printf_P(PSTR("%c: "), eeprom_read_word(( uint16_t *)114));
-	printf_P(PSTR("%d\n"), eeprom_read_word(( uint16_t *)6));
-	
-	printf_P(PSTR("%c"), eeprom_read_word(( uint16_t *)116));
-	printf_P(PSTR("%c: "), eeprom_read_word(( uint16_t *)118));
-	printf_P(PSTR("%d\n"), eeprom_read_word(( uint16_t *)8));
-}
+	move_cursor(20, 0);
+	hide_cursor();
+	printf_P(PSTR("Score: %s"), text);
+	move_cursor(0, 20);
+} 
 
-void write_eeprom_to_game(void) {
-	high_scores[0] = eeprom_read_word(( uint16_t *)0);
-	high_scores[1] = eeprom_read_word(( uint16_t *)2);
-	high_scores[2] = eeprom_read_word(( uint16_t *)4);
-	high_scores[3] = eeprom_read_word(( uint16_t *)6);
-	high_scores[4] = eeprom_read_word(( uint16_t *)8);
+uint32_t bcd_add(uint32_t a, uint32_t b) {
+	// Add 6 to every digit of a so that a digit sum of 10 or more 
+	// carries into the next digit as a binary add would. Then take the 6
+	// away again from the digits which didn't carry. The carries into 
+	// each digit are the bits where the sum differs from the exclusive
+	// or of the two numbers added.
+	uint32_t t1 = a + 0x66666666;
+	uint32_t t2 = t1 + b;
+	uint32_t no_carries = ~(t2 ^ t1 ^ b) & 0x11111110;
+	uint32_t adjust = (no_carries >> 2) | (no_carries >> 3);
+	if(t2 >= t1) {
+		// No carry out of the top digit
+		adjust |= 0x60000000;
+	}
+	return t2 - adjust;
 }
 
-void write_eeprom_to_game_names(void) {
-	high_score_names[0][0] = eeprom_read_word(( uint16_t *)100);
-	high_score_names[0][1] = eeprom_read_word(( uint16_t *)102);
-	
-	high_score_names[1][0] = eeprom_read_word(( uint16_t *)104);
-	high_score_names[1][1] = eeprom_read_word(( uint16_t *)106);
-	
-	high_score_names[2][0] = eeprom_read_word(( uint16_t *)108);
-	high_score_names[2][1] = eeprom_read_word(( uint16_t *)110);
-	
-	high_score_names[3][0] = eeprom_read_word(( uint16_t *)112);
-	high_score_names[3][1] = eeprom_read_word(( uint16_t *)114);
-	
-	high_score_names[4][0] = eeprom_read_word(( uint16_t *)116);
-	high_score_names[4][1] = eeprom_read_word(( uint16_t *)118);
+uint32_t bcd_to_binary(uint32_t bcd) {
+	uint32_t value = 0;
+	for(uint8_t i = 0; i < 8; i++) {
+		value = value * 10 + (bcd >> 28);
+		bcd <<= 4;
+	}
+	return value;
 }
 
-void write_name_to_eeprom2(uint8_t position) {
-	if (position <= 4) {
-		printf_P(PSTR("\nYou got a high score! Enter Your Name: "));
-		char name[2];
-		int i = 0;
-		while (i < 2) {
-			name[i] = fgetc(stdin);
-			if ((name[i] < 65) || (name[i] > 122)) {
-				continue; 
+uint32_t binary_to_bcd(uint32_t value) {
+	// Double dabble - shift the value into the BCD result a bit at a 
+	// time, first adding 3 to each digit of 5 or more so that it carries
+	// correctly when doubled
+	uint32_t bcd = 0;
+	for(uint8_t i = 0; i < 32; i++) {
+		for(uint8_t shift = 0; shift < 32; shift += 4) {
+			if(((bcd >> shift) & 0x0F) >= 5) {
+				bcd += (uint32_t)3 << shift;
 			}
-			printf_P(PSTR("%c"), name[i]);
-			i++;
-		}
-		clear_terminal();
-		
-		
-		for (int j = 3; j >= position; j--) {
-			high_score_names[j + 1][0] = high_score_names[j][0];
-			high_score_names[j + 1][1] = high_score_names[j][1];
 		}
-		
-		high_score_names[position][0] = name[0];
-		high_score_names[position][1] = name[1];
-		
-		eeprom_write_word(( uint16_t *)100, high_score_names[0][0]);
-		eeprom_write_word(( uint16_t *)102, high_score_names[0][1]);
-		
-		eeprom_write_word(( uint16_t *)104, high_score_names[1][0]);
-		eeprom_write_word(( uint16_t *)106, high_score_names[1][1]);
-		
-		eeprom_write_word(( uint16_t *)108, high_score_names[2][0]);
-		eeprom_write_word(( uint16_t *)110, high_score_names[2][1]);
-		
-		eeprom_write_word(( uint16_t *)112, high_score_names[3][0]);
-		eeprom_write_word(( uint16_t *)114, high_score_names[3][1]);
-		
-		eeprom_write_word(( uint16_t *)116, high_score_names[4][0]);
-		eeprom_write_word(( uint16_t *)118, high_score_names[4][1]);
-		
+		bcd = (bcd << 1) | (value >> 31);
+		value <<= 1;
 	}
+	return bcd;
 }
-
-/*void write_name_to_eeprom(uint8_t position) {
-	//If the person has made a new highscore
-	if (position <= 4) {
-		printf_P(PSTR("\nYou got a high score! Enter Your Name: "));
-		char name[2];
-		int i = 0;
-		while (i < 2) {
-			name[i] = fgetc(stdin);
-			printf_P(PSTR("%c"), name[i]);
-			i++;
-		}
-		clear_terminal();
-		if (position == 0) {
-			eeprom_write_word(( uint16_t *)100, name[0]);
-			eeprom_write_word(( uint16_t *)102, name[1]);
-			} else if (position == 1) {
-			eeprom_write_word(( uint16_t *)104, name[0]);
-			eeprom_write_word(( uint16_t *)106, name[1]);
-			} else if (position == 2) {
-			eeprom_write_word(( uint16_t *)108, name[0]);
-			eeprom_write_word(( uint16_t *)110, name[1]);
-			} else if (position == 3) {
-			eeprom_write_word(( uint16_t *)112, name[0]);
-			eeprom_write_word(( uint16_t *)114, name[1]);
-			} else if (position == 4) {
-			eeprom_write_word(( uint16_t *)116, name[0]);
-			eeprom_write_word(( uint16_t *)118, name[1]);
-			} else {
-		}	
-	}	
-}
-*/
\ No newline at end of file
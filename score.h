@@ -8,19 +8,35 @@
 #define SCORE_H_
 
 #include <stdint.h>
+#include "game.h"
 
-void init_score(void);
-void save_high_score_array(void);
-void add_to_score(uint16_t value);
-uint32_t get_score(void);
-void show_score_to_terminal();
-void display_high_score(void);
-void write_eeprom_to_game(void);
-void write_name_to_eeprom(uint8_t position); 
+/*
+ * The score is kept in packed BCD (binary coded decimal) - one decimal
+ * digit in each four bits, ones digit in the least significant four 
+ * bits - so it can be shown without dividing (which is slow on the AVR).
+ * It is 8 digits long. get_score() and set_score() work in binary, for
+ * saving and comparing scores.
+ */
+void init_score(GameState* game);
 
+/* Add the given number of points, given in packed BCD (e.g. 0x100 for 
+ * 100 points).
+ */
+void add_to_score(GameState* game, uint16_t value);
+void set_score(GameState* game, uint32_t value);
+uint32_t get_score(const GameState* game);
+uint32_t get_score_bcd(const GameState* game);
+void show_score_to_terminal(const GameState* game);
 
+/*
+ * Packed BCD arithmetic. bcd_add() adds two 8 digit numbers (any carry
+ * out of the top digit is lost). binary_to_bcd() converts a value below
+ * 100000000 by shifting rather than dividing, but is still much slower
+ * than the others so is only for values which don't change often.
+ */
+uint32_t bcd_add(uint32_t a, uint32_t b);
+uint32_t bcd_to_binary(uint32_t bcd);
+uint32_t binary_to_bcd(uint32_t value);
 
-void write_eeprom_to_game_names(void);
-void write_name_to_eeprom2(uint8_t position);
 
 #endif /* SCORE_H_ */
\ No newline at end of file
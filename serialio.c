@@ -25,6 +25,9 @@
 
 #include <avr/io.h>
 #include <avr/interrupt.h>
+#include <avr/pgmspace.h>
+
+#include "input.h"
 
 /* System clock rate in Hz. (L at the end indicates this is a long constant) */
 #define SYSCLK 8000000L
@@ -46,6 +49,11 @@ volatile char out_buffer[OUTPUT_BUFFER_SIZE];
 volatile uint8_t out_insert_pos;
 volatile uint8_t bytes_in_out_buffer;
 
+/* The most characters serial_write_P() copies into the output buffer with 
+ * interrupts disabled, so that other interrupts aren't held up for long.
+ */
+#define WRITE_CHUNK_SIZE 16
+
 /* Circular buffer to hold incoming characters. Works on same principle
  * as output buffer
  */
@@ -180,6 +188,36 @@ static int uart_put_char(char c, FILE* stream) {
 	return 0;
 }
 
+void serial_write_P(const char* string) {
+	uint8_t interrupts_enabled = bit_is_set(SREG, SREG_I);
+	char c = pgm_read_byte(string);
+	
+	while(c) {
+		// Wait for room in the buffer (as in uart_put_char())
+		while(bytes_in_out_buffer >= OUTPUT_BUFFER_SIZE) {
+			if(!interrupts_enabled) {
+				return;
+			}
+		}
+		
+		// Copy as much as fits (up to a chunk) with interrupts disabled
+		cli();
+		for(uint8_t i = 0; c && i < WRITE_CHUNK_SIZE && 
+				bytes_in_out_buffer < OUTPUT_BUFFER_SIZE; i++) {
+			out_buffer[out_insert_pos++] = c;
+			bytes_in_out_buffer++;
+			if(out_insert_pos == OUTPUT_BUFFER_SIZE) {
+				out_insert_pos = 0;
+			}
+			c = pgm_read_byte(++string);
+		}
+		UCSR0B |= (1 << UDRIE0);
+		if(interrupts_enabled) {
+			sei();
+		}
+	}
+}
+
 int uart_get_char(FILE* stream) {
 	/* Wait until we've received a character */
 	while(bytes_in_input_buffer == 0) {
@@ -273,6 +311,15 @@ ISR(USART0_RX_vect)
 		uart_put_char(c, 0);
 	}
 	
+	/*
+	 * If input is being routed to the input event queue then the
+	 * character is handled there rather than being buffered.
+	 */
+	if(input_enabled()) {
+		input_serial_char(c);
+		return;
+	}
+	
 	/* 
 	 * Check if we have space in our buffer. If not, set the overrun
 	 * flag and throw away the character. (We never clear the 
@@ -10,6 +10,8 @@
  * to print many characters at once to the buffer and have them 
  * output by the UART as speed permits.) Interrupts must be enabled 
  * globally for this module to work (after init_serial_stdio() is called).
+ * While the input event queue is enabled (see input.h) received characters
+ * are passed to it rather than being made available on standard input.
  *
  */
 
@@ -35,4 +37,14 @@ int8_t serial_input_available(void);
  */
 void clear_serial_input_buffer(void);
 
+/* Write the given string (in program memory) to the serial port as is,
+ * i.e. without \n being translated. This copies the string into the 
+ * output buffer in a few large pieces rather than a character at a time
+ * through the standard IO functions, so it's much quicker for long 
+ * strings such as prepared escape sequences. As with printf, this waits
+ * for room in the buffer if interrupts are enabled and discards what
+ * doesn't fit if they're not.
+ */
+void serial_write_P(const char* string);
+
 #endif /* SERIALIO_H_ */
\ No newline at end of file
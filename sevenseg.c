@@ -0,0 +1,139 @@
+/*
+ * sevenseg.c
+ *
+ * Author: Elliot Randall
+ *
+ * See sevenseg.h for details.
+ */
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <avr/pgmspace.h>
+
+#include "sevenseg.h"
+
+/* Timer 0 counts from 0 to 124 every millisecond (see timer0.c). Each
+ * digit is lit at count 0 and, unless at full brightness, blanked 
+ * on_counts later.
+ */
+#define COUNTS_PER_SLOT 125
+
+static const uint8_t digit_segments[10] PROGMEM = {
+	63, 6, 91, 79, 102, 109, 125, 7, 127, 111
+};
+
+/* Segment patterns ready to be written to PORTC */
+static volatile uint8_t segments[SEVEN_SEG_DIGITS];
+static volatile uint8_t current_digit;
+
+static volatile uint8_t on_counts = COUNTS_PER_SLOT;
+static volatile uint8_t blanking;
+
+/* The number currently shown, and whether it was given in binary or BCD
+ * (or neither, if the patterns have been set directly), so we only work
+ * out the patterns when it changes.
+ */
+#define SHOWN_NOTHING 0
+#define SHOWN_NUMBER 1
+#define SHOWN_BCD 2
+static uint16_t shown_value;
+static uint8_t shown_as;
+
+void init_seven_seg(void) {
+	for(uint8_t i = 0; i < SEVEN_SEG_DIGITS; i++) {
+		segments[i] = 0;
+	}
+	shown_as = SHOWN_NOTHING;
+	on_counts = COUNTS_PER_SLOT;
+	DDRA |= SEVEN_SEG_SELECT_MASK;
+	seven_seg_enable(0);
+}
+
+void seven_seg_enable(uint8_t enable) {
+	uint8_t interrupts_were_on = bit_is_set(SREG, SREG_I);
+	cli();
+	if(enable) {
+		blanking = 0;
+		OCR0B = 0;
+		TIFR0 = (1<<OCF0B);
+		TIMSK0 |= (1<<OCIE0B);
+	} else {
+		TIMSK0 &= ~(1<<OCIE0B);
+		PORTC = 0;
+	}
+	if(interrupts_were_on) {
+		sei();
+	}
+}
+
+void seven_seg_set_duty(uint8_t percent) {
+	if(percent == 0) {
+		percent = 1;
+	}
+	if(percent > 100) {
+		percent = 100;
+	}
+	// A single byte, so the interrupt handler can't see half a change
+	on_counts = (uint16_t)percent * COUNTS_PER_SLOT / 100;
+}
+
+void seven_seg_show_number(uint16_t value) {
+	if(shown_as == SHOWN_NUMBER && value == shown_value) {
+		return;
+	}
+	shown_value = value;
+	shown_as = SHOWN_NUMBER;
+	for(uint8_t i = 0; i < SEVEN_SEG_DIGITS; i++) {
+		segments[i] = pgm_read_byte(&digit_segments[value % 10]);
+		value /= 10;
+	}
+}
+
+void seven_seg_show_bcd(uint16_t bcd) {
+	if(shown_as == SHOWN_BCD && bcd == shown_value) {
+		return;
+	}
+	shown_value = bcd;
+	shown_as = SHOWN_BCD;
+	for(uint8_t i = 0; i < SEVEN_SEG_DIGITS; i++) {
+		segments[i] = pgm_read_byte(&digit_segments[bcd & 0x0F]);
+		bcd >>= 4;
+	}
+}
+
+void seven_seg_set_segments(uint8_t digit, uint8_t pattern) {
+	if(digit < SEVEN_SEG_DIGITS) {
+		segments[digit] = pattern;
+		shown_as = SHOWN_NOTHING;
+	}
+}
+
+/* Interrupt handler for timer 0 compare B. At the start of each slot we
+ * light the next digit; if dimmed, we come back part way through the 
+ * slot to blank it.
+ */
+ISR(TIMER0_COMPB_vect) {
+	if(blanking) {
+		PORTC = 0;
+		OCR0B = 0;
+		blanking = 0;
+		return;
+	}
+	uint8_t digit = current_digit + 1;
+	if(digit >= SEVEN_SEG_DIGITS) {
+		digit = 0;
+	}
+	current_digit = digit;
+	
+	// Blank the segments while we change digit so the old pattern 
+	// doesn't briefly show on the new digit
+	PORTC = 0;
+	PORTA = (PORTA & ~SEVEN_SEG_SELECT_MASK) | SEVEN_SEG_SELECT(digit);
+	PORTC = segments[digit];
+	
+	uint8_t counts = on_counts;
+	if(counts < COUNTS_PER_SLOT) {
+		OCR0B = counts;
+		blanking = 1;
+	}
+}
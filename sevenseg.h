@@ -0,0 +1,75 @@
+/*
+ * sevenseg.h
+ *
+ * Author: Elliot Randall
+ *
+ * Driver for a multiplexed seven segment display. The digits share the
+ * segment lines on PORTC and one digit at a time is selected on PORTA.
+ * The driver keeps the segment pattern for every digit ready to write 
+ * out, and the timer 0 compare B interrupt moves on to the next digit
+ * every millisecond. The display can be dimmed by turning each digit 
+ * off for part of its time slot.
+ *
+ * The patterns are only worked out again when the number shown 
+ * changes, so the interrupt handler never has to divide.
+ */
+
+#ifndef SEVENSEG_H_
+#define SEVENSEG_H_
+
+#include <stdint.h>
+
+/* Number of digits. Digit 0 is the rightmost (ones) digit. */
+#ifndef SEVEN_SEG_DIGITS
+#define SEVEN_SEG_DIGITS 2
+#endif
+
+/* PORTA value that selects the given digit, and the PORTA bits used to
+ * select digits (which are made outputs by init_seven_seg()). By 
+ * default, with two digits, PORTA bit 7 selects the tens digit when 
+ * high and the ones digit when low. More digits need their own select
+ * lines, so both must be defined along with SEVEN_SEG_DIGITS.
+ */
+#ifndef SEVEN_SEG_SELECT
+#if SEVEN_SEG_DIGITS > 2
+#error "Define SEVEN_SEG_SELECT(_MASK) for more than 2 digits"
+#endif
+#define SEVEN_SEG_SELECT(digit) ((digit) << PORTA7)
+#define SEVEN_SEG_SELECT_MASK (1 << PORTA7)
+#endif
+#ifndef SEVEN_SEG_SELECT_MASK
+#error "Define SEVEN_SEG_SELECT_MASK along with SEVEN_SEG_SELECT"
+#endif
+
+/* Set up the display - blank, at full brightness and turned off. Timer
+ * 0 must already be set up (see timer0.h) before the display is turned
+ * on.
+ */
+void init_seven_seg(void);
+
+/* Turn the display on (enable non-zero) or off.
+ */
+void seven_seg_enable(uint8_t enable);
+
+/* Set the brightness - the percentage (1 to 100) of each digit's time 
+ * slot for which it is lit.
+ */
+void seven_seg_set_duty(uint8_t percent);
+
+/* Show the given number. Only the lowest SEVEN_SEG_DIGITS digits are 
+ * shown, with leading zeros.
+ */
+void seven_seg_show_number(uint16_t value);
+
+/* Show the given number, given in packed BCD (see score.h). Only the 
+ * lowest SEVEN_SEG_DIGITS digits are shown. This is quicker than 
+ * seven_seg_show_number() as no dividing is needed.
+ */
+void seven_seg_show_bcd(uint16_t bcd);
+
+/* Show the given segment pattern on one digit. Bit 0 is segment A ... 
+ * bit 6 is segment G, bit 7 is the decimal point.
+ */
+void seven_seg_set_segments(uint8_t digit, uint8_t segments);
+
+#endif /* SEVENSEG_H_ */
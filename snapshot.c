@@ -0,0 +1,103 @@
+/*
+ * snapshot.c
+ *
+ * Author: Elliot Randall
+ *
+ * See snapshot.h for details.
+ */
+
+#include <avr/eeprom.h>
+#include <util/crc16.h>
+#include <stddef.h>
+
+#include "snapshot.h"
+#include "eeprom_queue.h"
+
+/* The snapshot as kept in EEPROM. version is 0 if there is no game to 
+ * carry on. The CRC covers the game. (Version 1 snapshots only held one
+ * upcoming block.)
+ */
+#define SNAPSHOT_VERSION 2
+typedef struct {
+	uint8_t version;
+	uint8_t crc[2];
+	GameSnapshot game;
+} SnapshotRecord;
+
+/* A copy of what is in EEPROM (once any queued bytes have been written),
+ * so we can tell which bytes a save needs to write.
+ */
+static SnapshotRecord saved;
+
+/* The snapshot must fit below the joystick calibration */
+_Static_assert(SNAPSHOT_ADDRESS + SNAPSHOT_SIZE <= 200, 
+		"game snapshot is too big for its space in EEPROM");
+
+static uint16_t snapshot_crc(const GameSnapshot* game) {
+	const uint8_t* bytes = (const uint8_t*)game;
+	uint16_t crc = 0xFFFF;
+	for(uint8_t i = 0; i < sizeof(GameSnapshot); i++) {
+		crc = _crc16_update(crc, bytes[i]);
+	}
+	return crc;
+}
+
+/* Write the bytes of the record from offset to offset + length - 1 which
+ * differ from the saved copy. They are queued as one run, from the first
+ * to the last which differs - the EEPROM queue skips any in between 
+ * which are already the same.
+ */
+static void write_changes(const SnapshotRecord* record, uint8_t offset, 
+		uint8_t length) {
+	const uint8_t* bytes = (const uint8_t*)record;
+	uint8_t* saved_bytes = (uint8_t*)&saved;
+	uint8_t first = offset + length;
+	uint8_t end = offset;
+	for(uint8_t i = offset; i < offset + length; i++) {
+		if(bytes[i] != saved_bytes[i]) {
+			if(first > i) {
+				first = i;
+			}
+			end = i + 1;
+			saved_bytes[i] = bytes[i];
+		}
+	}
+	if(first < end) {
+		eeprom_queue_write(SNAPSHOT_ADDRESS + first, &bytes[first], 
+				end - first);
+	}
+}
+
+uint8_t snapshot_load(void) {
+	eeprom_queue_flush();
+	eeprom_read_block(&saved, (const void*)SNAPSHOT_ADDRESS, 
+			sizeof(saved));
+	uint16_t crc = snapshot_crc(&saved.game);
+	return saved.version == SNAPSHOT_VERSION && 
+			saved.crc[0] == (crc & 0xFF) && saved.crc[1] == (crc >> 8);
+}
+
+const GameSnapshot* snapshot_game(void) {
+	return &saved.game;
+}
+
+void snapshot_save(const GameSnapshot* game) {
+	SnapshotRecord record;
+	uint16_t crc = snapshot_crc(game);
+	
+	record.version = SNAPSHOT_VERSION;
+	record.crc[0] = crc & 0xFF;
+	record.crc[1] = crc >> 8;
+	record.game = *game;
+	// Game first, then the version and CRC
+	write_changes(&record, offsetof(SnapshotRecord, game), 
+			sizeof(GameSnapshot));
+	write_changes(&record, 0, offsetof(SnapshotRecord, game));
+}
+
+void snapshot_clear(void) {
+	if(saved.version != 0) {
+		saved.version = 0;
+		eeprom_queue_write(SNAPSHOT_ADDRESS, &saved.version, 1);
+	}
+}
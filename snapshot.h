@@ -0,0 +1,49 @@
+/*
+ * snapshot.h
+ *
+ * Author: Elliot Randall
+ *
+ * Keeps a snapshot of the game being played in EEPROM (see 
+ * save_game_snapshot() in game.h) so that it can be carried on after a
+ * reset or power loss. The snapshot is saved each time a block is fixed
+ * to the board, but only the bytes which have changed since the last 
+ * save are written - usually just the score, block generator state and
+ * the rows the block landed in. Saves are written in the background 
+ * (see eeprom_queue.h).
+ *
+ * The snapshot is followed by a CRC which is written last, so a save 
+ * which is interrupted part way through leaves a snapshot which won't 
+ * load. When the game is over, the snapshot is cleared.
+ */
+
+#ifndef SNAPSHOT_H_
+#define SNAPSHOT_H_
+
+#include <stdint.h>
+#include "game.h"
+
+/* The snapshot occupies SNAPSHOT_SIZE bytes of EEPROM from 
+ * SNAPSHOT_ADDRESS.
+ */
+#define SNAPSHOT_ADDRESS 120
+#define SNAPSHOT_SIZE (3 + sizeof(GameSnapshot))
+
+/* Read the snapshot from EEPROM. Returns 1 if it holds a game which 
+ * hasn't finished, 0 otherwise. Must be called before the other 
+ * functions.
+ */
+uint8_t snapshot_load(void);
+
+/* Return the last snapshot loaded or saved.
+ */
+const GameSnapshot* snapshot_game(void);
+
+/* Save the given snapshot, writing only the bytes which have changed.
+ */
+void snapshot_save(const GameSnapshot* game);
+
+/* Note that the game is over, so there's nothing to carry on from.
+ */
+void snapshot_clear(void);
+
+#endif /* SNAPSHOT_H_ */
@@ -10,8 +10,6 @@
 
 #include <avr/io.h>
 #include <avr/interrupt.h>
-#include "score.h"
-#include "game.h"
 
 #include "timer0.h"
 
@@ -75,13 +73,67 @@ uint32_t get_clock_ticks(void) {
 	return return_value;
 }
 
+uint16_t get_clock_ticks16(void) {
+	uint16_t return_value;
+	
+	/* Only two bytes need to be copied with interrupts off. We restore
+	 * the status register rather than testing the interrupt flag.
+	 */
+	uint8_t sreg = SREG;
+	cli();
+	return_value = (uint16_t)clock_ticks;
+	SREG = sreg;
+	return return_value;
+}
+
+uint16_t get_fine_clock(void) {
+	uint16_t ticks;
+	uint8_t count;
+	
+	uint8_t interrupts_were_on = bit_is_set(SREG, SREG_I);
+	cli();
+	ticks = clock_ticks;
+	count = TCNT0;
+	/* If the counter has just been reset by a compare match but the
+	 * interrupt hasn't run yet (because interrupts are off), the tick
+	 * count is one behind.
+	 */
+	if((TIFR0 & (1<<OCF0A)) && count < 124) {
+		ticks++;
+	}
+	if(interrupts_were_on) {
+		sei();
+	}
+	/* 125 counts per tick. This wraps around, which is fine for
+	 * measuring intervals shorter than the wrap period.
+	 */
+	return ticks * 125 + count;
+}
+
+uint32_t get_clock_us(void) {
+	uint32_t ticks;
+	uint8_t count;
+	
+	/* As for get_fine_clock() */
+	uint8_t interrupts_were_on = bit_is_set(SREG, SREG_I);
+	cli();
+	ticks = clock_ticks;
+	count = TCNT0;
+	if((TIFR0 & (1<<OCF0A)) && count < 124) {
+		ticks++;
+	}
+	if(interrupts_were_on) {
+		sei();
+	}
+	return ticks * 1000 + count * 8;
+}
+
 /* Interrupt handler which fires when timer/counter 0 reaches 
- * the defined output compare value (every millisecond)
+ * the defined output compare value (every millisecond). This is kept
+ * short and calls no functions so that the compiler only needs to save
+ * the registers it uses.
  */
 ISR(TIMER0_COMPA_vect) {
 	/* Increment our clock tick count */
 	clock_ticks++;
-	if (get_is_running() == 1) {
-		update_seven_seg(); 	
-	}
 }
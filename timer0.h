@@ -31,4 +31,39 @@ void init_timer0(void);
  */
 uint32_t get_clock_ticks(void);
 
+/* Return a fine resolution clock value, in units of timer 0 counts 
+ * (8 microseconds). This wraps around about every 524ms so is only
+ * suitable for measuring short intervals (e.g. how long code takes to
+ * run) by subtracting two values.
+ */
+uint16_t get_fine_clock(void);
+
+/* Return the time since the timer was initialised in microseconds, to 
+ * the nearest 8us. This wraps around after about 71 minutes.
+ */
+uint32_t get_clock_us(void);
+
+/* Return the low 16 bits of the clock tick value. This is cheaper to
+ * read than get_clock_ticks() and is suitable for measuring intervals 
+ * of up to about 32 seconds.
+ */
+uint16_t get_clock_ticks16(void);
+
+/* Return non-zero if the clock tick value "now" has reached (is at or
+ * after) "deadline". Unlike now >= deadline, this stays correct when
+ * the clock wraps around, provided the two values are within half the
+ * range of the type of each other.
+ */
+static inline uint8_t ticks_reached(uint32_t now, uint32_t deadline) {
+	return (int32_t)(now - deadline) >= 0;
+}
+
+/* As for ticks_reached(), for deadlines set from get_clock_ticks16() 
+ * (e.g. the joystick auto-repeat). The deadline must be within about 32
+ * seconds of now.
+ */
+static inline uint8_t ticks16_reached(uint16_t now, uint16_t deadline) {
+	return (int16_t)(now - deadline) >= 0;
+}
+
 #endif
\ No newline at end of file
@@ -0,0 +1,178 @@
+/*
+ * timer1.c
+ *
+ * Author: Elliot Randall
+ *
+ * See timer1.h for details.
+ */
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <avr/pgmspace.h>
+#include <stdio.h>
+
+#include "timer1.h"
+
+/* We divide the 8MHz clock by 256, so the timer counts at 31250Hz, i.e.
+ * every 32us, or 125 counts every 4ms. In CTC mode the counter goes 
+ * from 0 up to the compare value inclusive, so an interval of n counts
+ * needs a compare value of n - 1. The longest interval is 65536 counts
+ * (about 2.1 seconds).
+ */
+#define TIMER1_CLOCK_BITS ((1<<CS12))
+#define MS_TO_COUNTS(ms) ((uint16_t)(((uint32_t)(ms) * 125) / 4 - 1))
+#define COUNTS_TO_US(counts) ((unsigned long)(counts) * 32)
+
+volatile uint8_t gravity_drop_pending;
+
+/* Compare value to use from the next drop on (when set_gravity_interval()
+ * couldn't use it for the current interval)
+ */
+static volatile uint16_t next_compare_value;
+
+/* Statistics. Latency is the time from when a drop was due to when it 
+ * was handled, in timer counts.
+ */
+static uint16_t drops_handled;
+static volatile uint16_t drops_missed;
+static uint16_t worst_latency;
+static uint32_t total_latency;
+static uint16_t last_latency;
+static uint16_t worst_jitter;
+
+void start_gravity_timer(uint16_t interval) {
+	/* Stop the timer while we set it up */
+	TCCR1B = 0;
+	TCNT1 = 0;
+	OCR1A = MS_TO_COUNTS(interval);
+	next_compare_value = OCR1A;
+	gravity_drop_pending = 0;
+	
+	drops_handled = 0;
+	drops_missed = 0;
+	worst_latency = 0;
+	total_latency = 0;
+	last_latency = 0;
+	worst_jitter = 0;
+	
+	/* Clear on compare match (CTC mode) with output compare A, and 
+	 * enable the compare match interrupt (clearing any old flag
+	 * by writing a 1 to it). Setting the clock bits starts the timer.
+	 */
+	TCCR1A = 0;
+	TIFR1 = (1<<OCF1A);
+	TIMSK1 |= (1<<OCIE1A);
+	TCCR1B = (1<<WGM12) | TIMER1_CLOCK_BITS;
+}
+
+void stop_gravity_timer(void) {
+	TCCR1B = 0;
+	TIMSK1 &= ~(1<<OCIE1A);
+	gravity_drop_pending = 0;
+}
+
+void pause_gravity_timer(void) {
+	/* Removing the clock stops the counter where it is */
+	TCCR1B = (1<<WGM12);
+	
+	/* A drop which is already due would otherwise be handled the moment
+	 * we resume (and its trigger flag would keep the gravity task due
+	 * while paused). The counter restarted from 0 when it was due, so 
+	 * restarting the interval instead costs at most the drop's latency.
+	 */
+	if(gravity_drop_pending || (TIFR1 & (1<<OCF1A))) {
+		restart_gravity_interval();
+	}
+}
+
+void resume_gravity_timer(void) {
+	TCCR1B = (1<<WGM12) | TIMER1_CLOCK_BITS;
+}
+
+void set_gravity_interval(uint16_t interval) {
+	uint16_t compare_value = MS_TO_COUNTS(interval);
+	uint8_t interrupts_were_on = bit_is_set(SREG, SREG_I);
+	cli();
+	next_compare_value = compare_value;
+	/* In CTC mode OCR1A isn't buffered, so a new compare value takes 
+	 * effect straight away - as long as the counter hasn't already 
+	 * passed it, or it would count on to 0xFFFF. It can go up by one 
+	 * while we do this (there are 256 clock cycles per count).
+	 */
+	if((uint32_t)TCNT1 + 1 < compare_value) {
+		OCR1A = compare_value;
+	}
+	if(interrupts_were_on) {
+		sei();
+	}
+}
+
+void restart_gravity_interval(void) {
+	uint8_t interrupts_were_on = bit_is_set(SREG, SREG_I);
+	cli();
+	TCNT1 = 0;
+	OCR1A = next_compare_value;
+	/* Cancel a drop which is already due - both a compare match whose
+	 * interrupt hasn't run yet and one which has set the flag
+	 */
+	TIFR1 = (1<<OCF1A);
+	gravity_drop_pending = 0;
+	if(interrupts_were_on) {
+		sei();
+	}
+	/* This interval isn't comparable with the last one */
+	last_latency = 0;
+}
+
+void gravity_drop_handled(void) {
+	/* The counter restarted from 0 when the drop was due, so the current
+	 * count is how late we are. (This assumes the drop is handled before
+	 * the next one is due.) The actual interval between this drop and
+	 * the last differs from the intended interval by the difference 
+	 * between their latencies.
+	 */
+	uint16_t latency;
+	uint8_t interrupts_were_on = bit_is_set(SREG, SREG_I);
+	cli();
+	latency = TCNT1;
+	if(interrupts_were_on) {
+		sei();
+	}
+	
+	uint16_t jitter = (latency > last_latency) ? latency - last_latency 
+			: last_latency - latency;
+	if(jitter > worst_jitter) {
+		worst_jitter = jitter;
+	}
+	if(latency > worst_latency) {
+		worst_latency = latency;
+	}
+	total_latency += latency;
+	last_latency = latency;
+	drops_handled++;
+}
+
+void print_gravity_timer_stats(void) {
+	uint32_t average_latency = 0;
+	if(drops_handled) {
+		average_latency = total_latency / drops_handled;
+	}
+	printf_P(PSTR("\nGRAVITY  drops %u  missed %u\n"), drops_handled, 
+			drops_missed);
+	printf_P(PSTR("latency (us)  worst %lu  average %lu\n"), 
+			COUNTS_TO_US(worst_latency), COUNTS_TO_US(average_latency));
+	printf_P(PSTR("worst interval error (us) %lu\n"), 
+			COUNTS_TO_US(worst_jitter));
+}
+
+/* Interrupt handler which fires when a gravity drop is due. The counter
+ * has just been reset to 0, so it is safe to change the compare value
+ * for the next interval here.
+ */
+ISR(TIMER1_COMPA_vect) {
+	if(gravity_drop_pending) {
+		drops_missed++;
+	}
+	gravity_drop_pending = 1;
+	OCR1A = next_compare_value;
+}
@@ -0,0 +1,69 @@
+/*
+ * timer1.h
+ *
+ * Author: Elliot Randall
+ *
+ * We use timer 1 to time gravity drops. The timer runs in CTC mode with
+ * an output compare interrupt at the drop interval, which sets the
+ * gravity_drop_pending flag when the drop is due no matter what the 
+ * main program is doing. The main program handles the drop when it
+ * can, and we measure how late that is compared to the intended time.
+ */
+
+#ifndef TIMER1_H_
+#define TIMER1_H_
+
+#include <stdint.h>
+
+/* Set by the interrupt handler when a gravity drop is due. Should be 
+ * cleared (with interrupts off, or using a scheduler trigger flag - see
+ * scheduler.h) by whoever handles the drop.
+ */
+extern volatile uint8_t gravity_drop_pending;
+
+/* Start timing gravity drops at the given interval (in ms, up to 2000).
+ * The first drop is due one interval from now. Also resets the 
+ * statistics below.
+ */
+void start_gravity_timer(uint16_t interval);
+
+/* Stop timing gravity drops.
+ */
+void stop_gravity_timer(void);
+
+/* Pause and resume the gravity timer. The time remaining until the next
+ * drop is kept while paused. A drop which is already due when the timer
+ * is paused is cancelled, and the next is due a whole interval after 
+ * resuming.
+ */
+void pause_gravity_timer(void);
+void resume_gravity_timer(void);
+
+/* Set the drop interval (in ms, up to 2000). This applies to the 
+ * current interval, which is timed from the last drop, unless more 
+ * than the new interval has already gone by - then the current interval
+ * keeps its old length and the new one applies from the next drop.
+ */
+void set_gravity_interval(uint16_t interval);
+
+/* Start the current interval again from now (e.g. because the player
+ * has dropped the block), cancelling any pending drop by clearing 
+ * gravity_drop_pending. A task triggered by the flag (see scheduler.h)
+ * which hasn't yet been made due then doesn't run.
+ */
+void restart_gravity_interval(void);
+
+/* Note that a pending gravity drop has been handled. This measures how
+ * late it was handled compared to when it was due.
+ */
+void gravity_drop_handled(void);
+
+/* Print the drop timing statistics to the terminal - the number of 
+ * drops, the worst and average time from when a drop was due to when 
+ * it was handled, the worst variation of the actual interval between
+ * drops from the intended one, and the number of drops missed (because
+ * the previous drop hadn't been handled yet).
+ */
+void print_gravity_timer_stats(void);
+
+#endif /* TIMER1_H_ */
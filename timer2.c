@@ -1,131 +1,211 @@
 /*
- * timer0.c
+ * timer2.c
  *
- * Author: Peter Sutton
+ * Author: Elliot Randall
  *
- * We setup timer0 to generate an interrupt every 1ms
- * We update a global clock tick variable - whose value
- * can be retrieved using the get_clock_ticks() function.
+ * See timer2.h for details.
  */
 
 #include <avr/io.h>
 #include <avr/interrupt.h>
+#include <avr/pgmspace.h>
 
-#include "timer0.h"
+#include "timer2.h"
 
-/* Our internal clock tick count - incremented every 
- * millisecond. Will overflow every ~49 days. */
-static volatile uint32_t clock_ticks;
+#ifndef F_CPU
+#define F_CPU 8000000L
+#endif
 
+/* A note is stored as the timer settings which produce it, so that the 
+ * interrupt handler doesn't have to do any arithmetic. The timer runs in
+ * CTC mode and toggles the buzzer pin on each compare match, so the pin 
+ * changes at twice the note frequency and "toggles" is the number of 
+ * compare matches the note lasts for. A note with toggles 0 ends an 
+ * effect.
+ */
+typedef struct {
+	uint8_t clock_select;	// Timer clock select bits, plus NOTE_REST
+	uint8_t compare;		// Output compare value
+	uint16_t toggles;
+} Note;
 
-void mute_timer(void) {
-	TCCR2B |= (1 << CS22) | (1 << CS21) | (CS20); 
-}
+/* Set in clock_select for a rest (buzzer pin not toggled) */
+#define NOTE_REST 0x80
 
-void clear_sound(void) {
-	/* Reset clock tick count. L indicates a long (32 bit) 
-	 * constant. 
-	 */
-	clock_ticks = 0L;
-	DDRD |= (1 << DDRD7) | (0<<DDRD6); 
-	
-	/* Clear the timer */
-	TCNT2 = 0;
+/* Notes from 489Hz up to 62.5kHz use a clock divider of 32, lower notes
+ * (down to 62Hz) use a divider of 256.
+ */
+#define NOTE_CLOCK_SELECT(freq) ((freq) >= 489 ? \
+		((1<<CS21)|(1<<CS20)) : ((1<<CS22)|(1<<CS21)))
+#define NOTE_DIVIDER(freq) ((freq) >= 489 ? 32UL : 256UL)
 
-	/* Set the output compare value to be 124 */
-	OCR2A = 124;
-	
-	/* Set the timer to clear on compare match (CTC mode)
-	 * and to divide the clock by 64. This starts the timer
-	 * running.
-	 */
-	TCCR2A = (1<<WGM21) | (1 << COM2A0);
-	TCCR2B = (1<<CS21)|(0<<CS20)|(1<<CS22);
+/* A note of the given frequency (Hz) and duration (ms) */
+#define NOTE(freq, ms) { NOTE_CLOCK_SELECT(freq), \
+		(uint8_t)(F_CPU / (2 * NOTE_DIVIDER(freq) * (freq)) - 1), \
+		(uint16_t)(2UL * (freq) * (ms) / 1000) }
 
-	/* Enable an interrupt on output compare match. 
-	 * Note that interrupts have to be enabled globally
-	 * before the interrupts will fire.
-	 */
-	TIMSK2 |= (1<<OCIE2A);
-	
-	/* Make sure the interrupt flag is cleared by writing a 
-	 * 1 to it.
-	 */
-	TIFR2 &= (1<<OCF2A);
+/* A rest of the given duration (ms). The timer divides the clock by 64 
+ * and counts to 125, i.e. one compare match per millisecond.
+ */
+#define REST(ms) { NOTE_REST | (1<<CS22), 124, (ms) }
+
+#define END_OF_EFFECT { 0, 0, 0 }
+
+static const Note start_notes[] PROGMEM = {
+	NOTE(500, 200), NOTE(4000, 200), NOTE(1000, 200), END_OF_EFFECT
+};
+static const Note rotate_notes[] PROGMEM = {
+	NOTE(4000, 40), END_OF_EFFECT
+};
+static const Note hard_drop_notes[] PROGMEM = {
+	NOTE(1000, 30), NOTE(700, 30), END_OF_EFFECT
+};
+static const Note lock_notes[] PROGMEM = {
+	NOTE(200, 30), END_OF_EFFECT
+};
+static const Note line_clear_notes[] PROGMEM = {
+	NOTE(1047, 60), NOTE(1319, 60), NOTE(1568, 100), END_OF_EFFECT
+};
+static const Note game_over_notes[] PROGMEM = {
+	NOTE(784, 200), REST(50), NOTE(659, 200), REST(50), NOTE(523, 200),
+	REST(50), NOTE(262, 600), END_OF_EFFECT
+};
+
+/* Indexed by SOUND_ effect number */
+static const Note* const sound_effects[] PROGMEM = {
+	start_notes, rotate_notes, hard_drop_notes, lock_notes, 
+	line_clear_notes, game_over_notes
+};
+#define NUM_SOUND_EFFECTS (sizeof(sound_effects) / sizeof(sound_effects[0]))
+
+/* Queue of effects waiting to be played. Effects are added at the head
+ * and removed from the tail.
+ */
+#define SOUND_QUEUE_SIZE 4
+static volatile uint8_t sound_queue[SOUND_QUEUE_SIZE];
+static volatile uint8_t queue_head;
+static volatile uint8_t queue_tail;
+static volatile uint8_t queue_length;
+
+/* Next note of the effect being played (0 if nothing is playing), and 
+ * the number of compare matches left in the current note.
+ */
+static const Note* volatile next_note;
+static volatile uint16_t toggles_remaining;
+
+static uint8_t muted(void) {
+	return (PIND & (1 << PIND6)) != 0;
 }
 
+/* Stop the timer and leave the buzzer pin low. Interrupts must be off.
+ */
+static void silence(void) {
+	TCCR2B = 0;
+	TCCR2A = 0;
+	PORTD &= ~(1 << PORTD7);
+	next_note = 0;
+	queue_length = 0;
+	queue_tail = queue_head;
+}
 
-void rotate_sound(void) {
-	/* Reset clock tick count. L indicates a long (32 bit) 
-	 * constant. 
-	 */
-	clock_ticks = 0L;
-	DDRD |= (1 << DDRD7) | (0<<DDRD6); 
+/* Start the next note of the current effect, or the first note of the 
+ * next queued effect if the current one has finished. Called from the
+ * interrupt handler, or with interrupts off.
+ */
+static void start_next_note(void) {
+	uint16_t toggles = 0;
+	
+	if(muted()) {
+		silence();
+		return;
+	}
+	if(next_note) {
+		toggles = pgm_read_word(&next_note->toggles);
+	}
+	while(toggles == 0) {
+		// Current effect has finished (or nothing is playing)
+		if(queue_length == 0) {
+			silence();
+			return;
+		}
+		next_note = pgm_read_ptr(&sound_effects[sound_queue[queue_tail]]);
+		queue_tail = (queue_tail + 1) % SOUND_QUEUE_SIZE;
+		queue_length--;
+		toggles = pgm_read_word(&next_note->toggles);
+	}
 	
-	/* Clear the timer */
+	uint8_t clock_select = pgm_read_byte(&next_note->clock_select);
+	OCR2A = pgm_read_byte(&next_note->compare);
 	TCNT2 = 0;
+	if(clock_select & NOTE_REST) {
+		TCCR2A = (1<<WGM21);
+		PORTD &= ~(1 << PORTD7);
+	} else {
+		// Toggle OC2A on compare match
+		TCCR2A = (1<<WGM21) | (1<<COM2A0);
+	}
+	TCCR2B = clock_select & ~NOTE_REST;
+	toggles_remaining = toggles;
+	next_note++;
+}
 
-	/* Set the output compare value to be 124 */
-	OCR2A = 124;
+void init_sound(void) {
+	// Buzzer output on D7, mute switch input on D6
+	DDRD |= (1 << DDRD7);
+	DDRD &= ~(1 << DDRD6);
 	
-	/* Set the timer to clear on compare match (CTC mode)
-	 * and to divide the clock by 64. This starts the timer
-	 * running.
-	 */
-	TCCR2A = (1<<WGM21) | (1 << COM2A0);
-	TCCR2B = (1<<CS21)|(0<<CS20);
-
-	/* Enable an interrupt on output compare match. 
-	 * Note that interrupts have to be enabled globally
-	 * before the interrupts will fire.
-	 */
-	TIMSK2 |= (1<<OCIE2A);
+	uint8_t interrupts_were_on = bit_is_set(SREG, SREG_I);
+	cli();
+	silence();
 	
-	/* Make sure the interrupt flag is cleared by writing a 
-	 * 1 to it.
+	/* Enable an interrupt on output compare match, making sure the 
+	 * interrupt flag is cleared first by writing a 1 to it.
 	 */
-	TIFR2 &= (1<<OCF2A);
+	TIFR2 = (1<<OCF2A);
+	TIMSK2 |= (1<<OCIE2A);
+	if(interrupts_were_on) {
+		sei();
+	}
 }
 
-void init_timer2(void) {
-	/* Reset clock tick count. L indicates a long (32 bit) 
-	 * constant. 
-	 */
-	clock_ticks = 0L;
-	DDRD |= (1 << DDRD7) | (0<<DDRD6); 
-	
-	/* Clear the timer */
-	TCNT2 = 0;
+void play_sound_effect(uint8_t effect) {
+	if(muted() || effect >= NUM_SOUND_EFFECTS) {
+		return;
+	}
+	uint8_t interrupts_were_on = bit_is_set(SREG, SREG_I);
+	cli();
+	if(queue_length < SOUND_QUEUE_SIZE) {
+		sound_queue[queue_head] = effect;
+		queue_head = (queue_head + 1) % SOUND_QUEUE_SIZE;
+		queue_length++;
+		if(!next_note) {
+			// Nothing playing - start now
+			start_next_note();
+		}
+	}
+	if(interrupts_were_on) {
+		sei();
+	}
+}
 
-	/* Set the output compare value to be 124 */
-	OCR2A = 124;
-	
-	/* Set the timer to clear on compare match (CTC mode)
-	 * and to divide the clock by 64. This starts the timer
-	 * running.
-	 */
-	TCCR2A = (1<<WGM21) | (1 << COM2A0);
-	TCCR2B = (1<<CS21)|(1<<CS20);
+void stop_sound(void) {
+	uint8_t interrupts_were_on = bit_is_set(SREG, SREG_I);
+	cli();
+	silence();
+	if(interrupts_were_on) {
+		sei();
+	}
+}
 
-	/* Enable an interrupt on output compare match. 
-	 * Note that interrupts have to be enabled globally
-	 * before the interrupts will fire.
-	 */
-	TIMSK2 |= (1<<OCIE2A);
-	
-	/* Make sure the interrupt flag is cleared by writing a 
-	 * 1 to it.
-	 */
-	TIFR2 &= (1<<OCF2A);
+uint8_t sound_playing(void) {
+	return next_note != 0;
 }
 
-/* Interrupt handler which fires when timer/counter 0 reaches 
- * the defined output compare value (every millisecond)
+/* Interrupt handler which fires on each compare match of the current 
+ * note. Moves on to the next note when this one's time is up.
  */
 ISR(TIMER2_COMPA_vect) {
-	if (clock_ticks < 300) {
-		clock_ticks ++; 
-	} else {
-		TCCR2A |= (1 << COM2A1) | (1 << COM2A0); 
+	if(--toggles_remaining == 0) {
+		start_next_note();
 	}
 }
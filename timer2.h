@@ -1,18 +1,18 @@
 /*
- * timer0.h
+ * timer2.h
  *
- * Author: Peter Sutton
+ * Author: Elliot Randall
  *
- * We set up timer 0 to give us an interrupt
- * every millisecond. Tasks that have to occur
- * regularly (every millisecond or few) can be added 
- * to the interrupt handler (in timer0.c) or can
- * be added to the main event loop that checks the
- * clock tick value. This value (32 bits) can be 
- * obtained using the get_clock_ticks() function.
- * (Any tasks undertaken in the interrupt handler
- * should be kept short so that we don't run the 
- * risk of missing an interrupt in future.)
+ * We use timer 2 to play sound effects on the piezo buzzer (OC2A, pin D7)
+ * without holding up the rest of the program. Each effect is a sequence
+ * of notes (a frequency and a duration) stored in program memory. The 
+ * timer toggles the buzzer pin at the frequency of the current note and
+ * its interrupt handler moves on to the next note (and the next queued
+ * effect) when the note's time is up.
+ *
+ * Effects are not played (and any playing effect stops at the end of 
+ * the current note) while the mute switch (pin D6) is on, so callers 
+ * don't need to check it.
  */
 
 #ifndef TIMER2_H_
@@ -20,16 +20,32 @@
 
 #include <stdint.h>
 
-/* Set up our timer to give us an interrupt every millisecond
- * and update our time reference. Note: interrupts will need 
- * to be enabled globally for this to work.
+/* Sound effects */
+#define SOUND_START 0
+#define SOUND_ROTATE 1
+#define SOUND_HARD_DROP 2
+#define SOUND_LOCK 3
+#define SOUND_LINE_CLEAR 4
+#define SOUND_GAME_OVER 5
+
+/* Set up the buzzer output and timer 2. Note: interrupts will need to be
+ * enabled globally for sound effects to play.
+ */
+void init_sound(void);
+
+/* Play the given sound effect (one of the SOUND_ values above) when any
+ * effects already queued have finished. Up to four effects can be 
+ * queued - if the queue is full the effect is not played.
  */
-void init_timer2(void);
-void rotate_sound(void);
-void clear_sound(void);
-void mute_timer(void);
-/* Return the current clock tick value - milliseconds since the timer was
- * initialised.
+void play_sound_effect(uint8_t effect);
+
+/* Stop any sound effect which is playing and discard any queued 
+ * effects.
+ */
+void stop_sound(void);
+
+/* Return 1 if a sound effect is playing, 0 otherwise.
  */
+uint8_t sound_playing(void);
 
-#endif
\ No newline at end of file
+#endif /* TIMER2_H_ */